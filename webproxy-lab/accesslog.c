@@ -0,0 +1,114 @@
+#include "accesslog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+static AccessLog access_log;
+static int accesslog_enabled = 0;
+
+uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint32_t elapsed_us(uint64_t from, uint64_t to){
+    if (from == 0 || to < from) return 0;
+    return (uint32_t)((to - from) / 1000);
+}
+
+/*
+ * 락을 잡은 상태에서 호출. 쌓인 레코드를 파일로 내보낸다.
+ * 쓰는 동안은 락을 놓는다: 디스크가 느려도 accesslog_push(요청 경로)는 막히지 않음.
+ * [tail, head) 구간은 tail을 옮기기 전까지 push가 덮어쓰지 않으므로 락 없이 읽어도 된다
+ */
+static void flush_pending(){
+    unsigned tail = access_log.tail, head = access_log.head;
+
+    if (tail == head)
+        return;
+    pthread_mutex_unlock(&access_log.lock);
+    while (tail != head) {
+        unsigned idx = tail % ACCESSLOG_RING;
+        //링 끝에서 잘리지 않는 만큼 한 번에 쓴다
+        unsigned n = head - tail;
+        if (idx + n > ACCESSLOG_RING)
+            n = ACCESSLOG_RING - idx;
+        fwrite(&access_log.ring[idx], sizeof(AccessRecord), n, access_log.fp);
+        tail += n;
+    }
+    fflush(access_log.fp);
+    pthread_mutex_lock(&access_log.lock);
+    access_log.tail = tail;
+}
+
+static void *flusher_thread(void *vargp){
+    pthread_mutex_lock(&access_log.lock);
+    while (access_log.running) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += ACCESSLOG_FLUSH_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&access_log.cond, &access_log.lock, &ts);
+        flush_pending();
+    }
+    flush_pending();
+    pthread_mutex_unlock(&access_log.lock);
+    return NULL;
+}
+
+int init_accesslog(const char *path){
+    AccessLogHeader hdr = { ACCESSLOG_MAGIC, 1, sizeof(AccessRecord) };
+
+    if ((access_log.fp = fopen(path, "wb")) == NULL) {
+        fprintf(stderr, "init_accesslog: cannot open %s\n", path);
+        return -1;
+    }
+    fwrite(&hdr, sizeof(hdr), 1, access_log.fp);
+
+    access_log.head = access_log.tail = 0;
+    access_log.dropped = 0;
+    access_log.running = 1;
+    pthread_mutex_init(&access_log.lock, NULL);
+    pthread_cond_init(&access_log.cond, NULL);
+    pthread_create(&access_log.flusher, NULL, flusher_thread, NULL);
+    accesslog_enabled = 1;
+    return 0;
+}
+
+void deinit_accesslog(){
+    if (!accesslog_enabled) return;
+    accesslog_enabled = 0;
+
+    pthread_mutex_lock(&access_log.lock);
+    access_log.running = 0;
+    pthread_cond_signal(&access_log.cond);
+    pthread_mutex_unlock(&access_log.lock);
+    pthread_join(access_log.flusher, NULL);
+
+    if (access_log.dropped)
+        fprintf(stderr, "accesslog: dropped %lu records\n", access_log.dropped);
+    fclose(access_log.fp);
+}
+
+//요청 경로에서 호출됨. 파일 I/O는 절대 하지 않고 링에 복사만 한다
+void accesslog_push(const AccessRecord *rec){
+    if (!accesslog_enabled) return;
+
+    pthread_mutex_lock(&access_log.lock);
+    if (access_log.head - access_log.tail >= ACCESSLOG_RING) {
+        //flusher가 못 따라오면 기다리지 않고 버린다
+        access_log.dropped++;
+    } else {
+        access_log.ring[access_log.head % ACCESSLOG_RING] = *rec;
+        access_log.head++;
+        //절반 넘게 찼으면 주기 기다리지 말고 바로 깨움
+        if (access_log.head - access_log.tail == ACCESSLOG_RING / 2)
+            pthread_cond_signal(&access_log.cond);
+    }
+    pthread_mutex_unlock(&access_log.lock);
+}
@@ -0,0 +1,57 @@
+#ifndef __ACCESSLOG_H__
+#define __ACCESSLOG_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* 요청 하나를 처리하면서 거치는 단계들 */
+enum {
+    PHASE_PARSE,    // 요청 라인 + 헤더 파싱
+    PHASE_LOOKUP,   // find_cache (락 대기 포함)
+    PHASE_CONNECT,  // Open_clientfd (DNS + connect)
+    PHASE_TTFB,     // 요청 전송 ~ 서버의 첫 응답 바이트
+    PHASE_TRANSFER, // 첫 바이트 ~ 클라이언트 전송 완료
+    NPHASE
+};
+
+#define ACCESSLOG_MAGIC 0x4c415850 /* "PXAL" */
+#define ACCESSLOG_RING 4096        // 링 버퍼 레코드 수
+#define ACCESSLOG_FLUSH_MS 100     // 백그라운드 flush 주기
+
+/* 파일 맨 앞에 한 번 기록되는 헤더 */
+typedef struct _AccessLogHeader{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rec_size; //레코드 크기 (호환성 체크용)
+} AccessLogHeader;
+
+/* 요청 하나당 한 레코드. 시간은 전부 CLOCK_MONOTONIC 기준 */
+typedef struct _AccessRecord{
+    uint64_t start_ns;          // 요청 시작 시각
+    uint32_t phase_us[NPHASE];  // 각 단계 소요 시간 (안 거친 단계는 0)
+    uint32_t bytes;             // 클라이언트로 보낸 바이트
+    uint16_t status;            // 응답 상태 코드
+    uint8_t cache_hit;
+    uint8_t pad;
+} AccessRecord;
+
+typedef struct _AccessLog{
+    AccessRecord ring[ACCESSLOG_RING];
+    unsigned head; //다음에 쓸 위치
+    unsigned tail; //다음에 flush할 위치
+    unsigned long dropped; //링이 꽉 차서 버린 레코드 수
+    int running;
+    FILE *fp;
+    pthread_t flusher;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} AccessLog;
+
+uint64_t now_ns();
+uint32_t elapsed_us(uint64_t from, uint64_t to);
+int init_accesslog(const char *path);
+void deinit_accesslog();
+void accesslog_push(const AccessRecord *rec);
+
+#endif /* __ACCESSLOG_H__ */
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/un.h>
+#include "csapp.h"
+#include "cache.h"
+#include "stats.h"
+#include "admin.h"
+#include "handoff.h"
+
+static int admin_fd = -1;
+static size_t object_limit; //프록시의 요청별 버퍼 크기. 이보다 큰 maxobject는 거절
+
+//관리 클라이언트가 먼저 끊어도 프록시가 SIGPIPE로 죽지 않게 MSG_NOSIGNAL로 보낸다
+static void send_all(int fd, const char *buf, size_t n){
+    ssize_t w;
+
+    while (n > 0) {
+        if ((w = send(fd, buf, n, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        buf += w;
+        n -= w;
+    }
+}
+
+static void reply(int fd, const char *fmt, ...){
+    char buf[MAXLINE];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n >= (int)sizeof(buf))
+        n = sizeof(buf) - 1;
+    send_all(fd, buf, n);
+}
+
+static void cmd_stats(int fd){
+    char buf[STATS_BUF];
+    size_t entries, bytes, capacity, max_object;
+
+    send_all(fd, buf, format_stats(buf, sizeof(buf)));
+    cache_summary(&entries, &bytes, &capacity, &max_object);
+    reply(fd, "cache: entries %zu  bytes %zu / %zu (%.1f%%)  max object %zu\n",
+          entries, bytes, capacity, capacity ? 100.0 * bytes / capacity : 0.0, max_object);
+}
+
+static void cmd_top(int fd, char *args){
+    CacheEntryInfo top[ADMIN_TOP_MAX];
+    char *tok, *save, *end;
+    int n = 10, by_hits = 0, count;
+    time_t now = time(NULL);
+
+    //"top", "top 5", "top hits", "top 5 hits" 모두 받도록 단어마다 따로 본다
+    for (tok = strtok_r(args, " \t", &save); tok; tok = strtok_r(NULL, " \t", &save)) {
+        long v = strtol(tok, &end, 10);
+        if (*end == '\0')
+            n = v;
+        else if (!strcmp(tok, "hits") || !strcmp(tok, "size"))
+            by_hits = !strcmp(tok, "hits");
+        else {
+            reply(fd, "error: top [n] [size|hits]\n");
+            return;
+        }
+    }
+    if (n <= 0 || n > ADMIN_TOP_MAX)
+        n = ADMIN_TOP_MAX;
+    count = cache_top(top, n, by_hits);
+    for (int i = 0; i < count; i++)
+        reply(fd, "%8zu %8lu %8ld  %s\n", top[i].size, top[i].hits,
+              (long)(top[i].expires - now), top[i].uri);
+    reply(fd, "%d entries (size hits ttl uri)\n", count);
+}
+
+static void cmd_purge(int fd, char *uri){
+    size_t len = strlen(uri);
+    int prefix = len > 0 && uri[len - 1] == '*';
+
+    if (prefix)
+        uri[len - 1] = '\0';
+    if (uri[0] == '\0') {
+        reply(fd, "error: purge <uri>[*]\n");
+        return;
+    }
+    reply(fd, "purged %d\n", cache_purge(uri, prefix));
+}
+
+static void cmd_limits(int fd, char *cmd, char *args){
+    long v = atol(args);
+
+    if (v <= 0) {
+        reply(fd, "error: %s <bytes>\n", cmd);
+        return;
+    }
+    if (!strcmp(cmd, "maxobject") && (size_t)v > object_limit) {
+        reply(fd, "error: maxobject is limited to %zu\n", object_limit);
+        return;
+    }
+    if (!strcmp(cmd, "capacity"))
+        reply(fd, "evicted %d\n", cache_set_limits(v, 0));
+    else
+        reply(fd, "evicted %d\n", cache_set_limits(0, v));
+}
+
+//듣기 소켓들을 넘긴다 (새 프로세스의 handoff_fetch). 텍스트 답에 fd가 붙어 감
+static void cmd_listeners(int fd){
+    struct timeval none = { 0, 0 };
+
+    if (handoff_send_listeners(fd) < 0) {
+        reply(fd, "error: no listeners to hand off (draining)\n");
+        return;
+    }
+    //새 프로세스는 캐시를 읽는 동안 이 연결을 쥐고 있다가 drain을 보내므로 끊지 않는다
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &none, sizeof(none));
+}
+
+//drain은 시그널 스레드가 맡는다: SIGTERM과 같은 경로
+static void cmd_drain(int fd){
+    reply(fd, "draining\n");
+    kill(getpid(), SIGTERM);
+}
+
+static void cmd_snapshot(int fd, char *path){
+    int n;
+
+    if (path[0] == '\0') {
+        reply(fd, "error: snapshot <path>\n");
+        return;
+    }
+    if ((n = cache_save_snapshot(path)) < 0)
+        reply(fd, "error: cannot write %s: %s\n", path, strerror(errno));
+    else
+        reply(fd, "saved %d\n", n);
+}
+
+//연결 하나에서 EOF까지 명령을 한 줄씩 처리
+static void serve_admin(int fd){
+    rio_t rio;
+    char line[MAXLINE], cmd[32], *args;
+
+    rio_readinitb(&rio, fd);
+    while (rio_readlineb(&rio, line, MAXLINE) > 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (sscanf(line, "%31s", cmd) != 1)
+            continue;
+        args = line + strspn(line, " \t") + strlen(cmd);
+        args += strspn(args, " \t");
+
+        if (!strcmp(cmd, "stats"))
+            cmd_stats(fd);
+        else if (!strcmp(cmd, "top"))
+            cmd_top(fd, args);
+        else if (!strcmp(cmd, "purge"))
+            cmd_purge(fd, args);
+        else if (!strcmp(cmd, "capacity") || !strcmp(cmd, "maxobject"))
+            cmd_limits(fd, cmd, args);
+        else if (!strcmp(cmd, "listeners"))
+            cmd_listeners(fd);
+        else if (!strcmp(cmd, "drain"))
+            cmd_drain(fd);
+        else if (!strcmp(cmd, "snapshot"))
+            cmd_snapshot(fd, args);
+        else
+            reply(fd, "error: unknown command %s (stats, top, purge, capacity, maxobject, listeners, drain, snapshot)\n", cmd);
+    }
+}
+
+//관리 명령은 드물고 짧으므로 스레드 하나가 차례로 처리한다
+static void *admin_thread(void *vargp){
+    int fd;
+    struct timeval idle = { ADMIN_IDLE_TIMEOUT, 0 };
+
+    pthread_detach(pthread_self());
+    while (1) {
+        if ((fd = accept(admin_fd, NULL, NULL)) < 0)
+            continue;
+        //아무것도 안 보내고 붙어만 있는 클라이언트가 관리 채널을 독차지하지 못하게
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+        serve_admin(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+/*
+ * path에 유닉스 소켓을 열고(주인만 접근 가능) 관리 스레드를 띄운다.
+ * max_object_limit은 maxobject로 올릴 수 있는 최대값. 실패하면 -1
+ */
+int admin_start(const char *path, size_t max_object_limit){
+    struct sockaddr_un addr;
+    pthread_t tid;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((admin_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    fcntl(admin_fd, F_SETFD, FD_CLOEXEC);
+    unlink(path); //지난번 실행이 남긴 소켓 파일
+    if (bind(admin_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || chmod(path, 0600) < 0 || listen(admin_fd, 8) < 0) {
+        close(admin_fd);
+        admin_fd = -1;
+        return -1;
+    }
+    object_limit = max_object_limit;
+    Pthread_create(&tid, NULL, admin_thread, NULL);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef __ADMIN_H__
+#define __ADMIN_H__
+
+/*
+ * 로컬 관리 채널 (-s <경로>). 유닉스 소켓에 한 줄짜리 명령을 보내면 답을 준다:
+ *   stats                      프록시 통계 + 캐시 사용량
+ *   top [n] [size|hits]        크기(또는 조회 수)가 큰 엔트리 n개 (기본 10)
+ *   purge <uri>                그 uri의 모든 변형을 지움 (끝이 *이면 그걸로 시작하는 전부)
+ *   capacity <bytes>           캐시 용량을 바꿈 (넘치는 건 조금씩 내보냄)
+ *   maxobject <bytes>          저장할 최대 응답 크기를 바꿈 (프록시 버퍼 크기까지)
+ *   listeners                  듣기 소켓들을 SCM_RIGHTS로 넘김 (새 프로세스의 -x가 씀)
+ *   drain                      새 연결을 그만 받고 처리 중인 요청이 끝나면 종료 (SIGTERM과 같음)
+ *   snapshot <path>            캐시를 스냅샷 파일로 씀 (새 프로세스의 -x도 이걸로 캐시를 넘겨받음)
+ * 예: echo 'top 5 hits' | nc -U /tmp/proxy.sock
+ */
+#define ADMIN_TOP_MAX 100
+#define ADMIN_IDLE_TIMEOUT 10 //명령 없이 이만큼(초) 지나면 연결을 끊음 (관리 스레드가 하나라 다른 클라이언트가 막힘)
+
+int admin_start(const char *path, size_t max_object_limit);
+
+#endif /* __ADMIN_H__ */
@@ -0,0 +1,165 @@
+#!/bin/bash
+#
+# bench.sh - Reproducible proxy benchmark. Starts tiny on a free port,
+#     then for every proxy configuration in CONFIGS starts the proxy,
+#     runs the fixed workload matrix below with ./loadgen and appends
+#     one tab-separated row per (config, workload) to the results file.
+#
+#     Diff two results files (or load them into a spreadsheet) to see
+#     throughput/latency regressions between commits.
+#
+#     usage: ./bench.sh [results-file]     (default: bench_results.tsv)
+#     env:   BENCH_SECS   seconds per workload (default 5)
+#            BENCH_CONNS  concurrent connections (default 8)
+#
+
+set -f    # URIs like /cgi-bin/adder?x=1&y=2 must not be globbed
+HOME_DIR=`pwd`
+RESULTS=${1:-bench_results.tsv}
+SECS=${BENCH_SECS:-5}
+CONNS=${BENCH_CONNS:-8}
+TIMEOUT_MS=1000
+LARGE_FILE="bench-large.bin"
+LARGE_MB=8
+
+# Proxy configurations: "<name>|<extra proxy flags>".
+# "direct" runs the workloads against tiny without a proxy (baseline).
+CONFIGS=("direct|"
+         "default|"
+         "accesslog|-l /tmp/bench-accesslog.$$"
+         "reuseport|-w `nproc` -a"
+         "tuned|-w `nproc` -a -o nodelay,defer=1,fastopen=256,backlog=4096"
+         "uring|-e uring"
+         "coro|-c `nproc`")
+
+# Workloads: "<name>|<loadgen flags>|<uris>"
+# Without -k every request opens a new connection, so rps is also the
+# connections/sec the proxy sustains.
+WORKLOADS=("all-hit|-z 0|/home.html"
+           "all-miss|-b -z 0|/home.html /tiny.c /csapp.c"
+           "all-hit-gzip|-z 0 -H Accept-Encoding:gzip|/home.html /tiny.c /csapp.c"
+           "mixed-zipf|-z 1.0|/home.html /csapp.c /tiny.c /godzilla.jpg /godzilla.gif /test.mpg /cgi-bin/adder?x=1&y=2"
+           "large-object|-z 0 -c 2|/${LARGE_FILE}"
+           "video-seek|-z 0 -R 8192:62842|/test.mpg"
+           "large-seek|-z 0 -c 2 -R 65536:$((LARGE_MB * 1024 * 1024))|/${LARGE_FILE}")
+
+#####
+# Helper functions
+#
+
+#
+# free_port - ask free-port.sh for an unused TCP port
+#
+function free_port {
+    bash ./free-port.sh
+}
+
+#
+# wait_for_port_use - spin until something listens on port $1 (max 5s)
+#
+function wait_for_port_use {
+    for i in `seq 50`
+    do
+        netstat --numeric-ports --numeric-hosts -ltn | grep -q ":${1} " && return
+        sleep 0.1
+    done
+    echo "Error: nothing is listening on port ${1}"
+    cleanup
+    exit 1
+}
+
+function cleanup {
+    kill ${proxy_pid} ${tiny_pid} ${nop_pid} 2> /dev/null
+    rm -f ./tiny/${LARGE_FILE} /tmp/bench-accesslog.$$ /tmp/bench-stats.$$
+}
+
+#
+# run_workload - run one workload and append its row to the results
+# usage: run_workload <config> <workload> <target flags> <loadgen flags> <uris>
+#
+function run_workload {
+    row=`./loadgen -m -d ${SECS} -c ${CONNS} -t ${TIMEOUT_MS} $3 $4 localhost ${tiny_port} $5`
+    printf "%s\t%s\t%s\t%s\n" "${commit}" "$1" "$2" "${row}" >> ${RESULTS}
+    printf "  %-14s %s\n" "$2" "${row}"
+}
+
+#######
+# Main
+#######
+
+for prog in ./proxy ./loadgen ./tiny/tiny ./tiny/cgi-bin/adder
+do
+    if [ ! -x ${prog} ]
+    then
+        echo "Error: ${prog} not found. Run 'make bench' to build everything."
+        exit 1
+    fi
+done
+
+trap 'cleanup; exit 1' INT TERM
+killall -q proxy tiny nop-server.py 2> /dev/null
+commit=`git rev-parse --short HEAD 2> /dev/null || echo unknown`
+head -c $((LARGE_MB * 1024 * 1024)) /dev/urandom > ./tiny/${LARGE_FILE}
+
+if [ ! -s ${RESULTS} ]
+then
+    printf "commit\tconfig\tworkload\trequests\terrors\tsecs\trps\tmbps\tp50_us\tp99_us\tp999_us\tmax_us\n" > ${RESULTS}
+fi
+
+tiny_port=$(free_port)
+cd ./tiny
+./tiny ${tiny_port} &> /dev/null &
+tiny_pid=$!
+cd ${HOME_DIR}
+wait_for_port_use ${tiny_port}
+echo "tiny on ${tiny_port}, ${SECS}s x ${CONNS} conns per workload"
+
+for config in "${CONFIGS[@]}"
+do
+    name=${config%%|*}
+    flags=${config#*|}
+    proxy_pid=""
+    target=""
+    if [ "${name}" != "direct" ]
+    then
+        proxy_port=$(free_port)
+        ./proxy ${flags} ${proxy_port} > /dev/null 2> /tmp/bench-stats.$$ &
+        proxy_pid=$!
+        wait_for_port_use ${proxy_port}
+        target="-x localhost:${proxy_port}"
+    fi
+    echo "${name}"
+
+    for workload in "${WORKLOADS[@]}"
+    do
+        IFS='|' read wname wflags wuris <<< "${workload}"
+        run_workload "${name}" "${wname}" "${target}" "${wflags}" "${wuris}"
+    done
+
+    # Slow origin: a few connections stuck on nop-server.py must not
+    # slow down requests to tiny (only meaningful through the proxy).
+    if [ -n "${proxy_pid}" ]
+    then
+        nop_port=$(free_port)
+        python3 ./nop-server.py ${nop_port} &> /dev/null &
+        nop_pid=$!
+        wait_for_port_use ${nop_port}
+        ./loadgen -m -d ${SECS} -c 2 -t $((SECS * 1000)) ${target} localhost ${nop_port} /home.html > /dev/null &
+        stuck_pid=$!
+        run_workload "${name}" "slow-origin" "${target}" "-z 0" "/home.html"
+        wait ${stuck_pid}
+        kill ${nop_pid} 2> /dev/null
+        nop_pid=""
+    fi
+
+    if [ -n "${proxy_pid}" ]
+    then
+        kill -INT ${proxy_pid} 2> /dev/null
+        wait ${proxy_pid} 2> /dev/null
+        # syscalls/request over the whole config (printed by the proxy on exit)
+        grep "^io:" /tmp/bench-stats.$$ | tail -1 | sed 's/^/  /'
+    fi
+done
+
+cleanup
+echo "Results appended to ${RESULTS}"
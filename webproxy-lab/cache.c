@@ -2,22 +2,28 @@
 
 
 CacheList cache_list;
+int refresh_min_hits = REFRESH_MIN_HITS;
 
 void init_cache(){
     cache_list.head=NULL;
     cache_list.tail=NULL;
     cache_list.total_size=0;
     cache_list.capacity=MAX_CACHE_SIZE;
+    cache_list.max_object=MAX_OBJECT_SIZE;
+    cache_list.entries=0;
+    memset(cache_list.buckets, 0, sizeof(cache_list.buckets));
     pthread_rwlock_init(&cache_list.lock, NULL);
 }
 
 void deinit_cache(){
-    pthread_rwlock_wrlock(&cache_list);
+    pthread_rwlock_wrlock(&cache_list.lock);
 
     CacheNode* temp = cache_list.head;
     while(temp){        
         CacheNode *next= temp->next;
-        free(temp->data);
+        free(temp->vary_key);
+        free(temp->hdr);
+        release_cache_body(temp->body);
         free(temp);
         temp=next;
     }
@@ -25,34 +31,157 @@ void deinit_cache(){
     cache_list.head=NULL;
     cache_list.tail=NULL;
     cache_list.total_size=0;
+    cache_list.entries=0;
+    memset(cache_list.buckets, 0, sizeof(cache_list.buckets));
 
     pthread_rwlock_unlock(&cache_list.lock);
     pthread_rwlock_destroy(&cache_list.lock);
+}
+
+// FNV-1a
+static unsigned long uri_hash(const char *uri){
+    unsigned long hash = 14695981039346656037UL;
+
+    for (const unsigned char *p = (const unsigned char *)uri; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211UL;
+    }
+    return hash;
+}
+
+/*
+ * uri를 정규화하고 해시를 구한다. "http://Host:80/a"와 "http://host/a"가
+ * 같은 키가 된다. 정규화할 수 없을 만큼 길면 원래 문자열을 그대로 쓴다.
+ */
+void make_cache_key(CacheKey *key, const char *uri){
+    if (normalize_uri(uri, key->uri, MAXLINE) < 0) {
+        strncpy(key->uri, uri, MAXLINE - 1);
+        key->uri[MAXLINE - 1] = '\0';
+    }
+    key->hash = uri_hash(key->uri);
+}
+
+/* 보내는 쪽이 다 썼거나 노드가 빠질 때. 마지막 참조면 본문을 반환 */
+void release_cache_body(CacheBody *body){
+    if (body && __atomic_sub_fetch(&body->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        free(body);
+}
 
-    Free(&cache_list);
+static CacheNode **bucket_of(unsigned long hash){
+    return &cache_list.buckets[hash & (CACHE_BUCKETS - 1)];
+}
+
+static int same_key(const CacheNode *node, const CacheKey *key){
+    return node->hash == key->hash && strcmp(node->uri, key->uri) == 0;
+}
+
+//key + vary_key가 정확히 같은 노드 (락 잡은 상태에서 호출)
+static CacheNode *lookup_variant(const CacheKey *key, const char *vary_key){
+    for (CacheNode *temp = *bucket_of(key->hash); temp; temp = temp->hnext)
+        if (same_key(temp, key) && strcmp(temp->vary_key, vary_key) == 0)
+            return temp;
+    return NULL;
+}
 
+//리스트와 해시 버킷에서 노드를 떼어내고 메모리 반환 (락 잡은 상태에서 호출)
+static void remove_node(CacheNode *node){
+    CacheNode **pp = bucket_of(node->hash);
+    while (*pp != node)
+        pp = &(*pp)->hnext;
+    *pp = node->hnext;
+
+    if (node->prev)
+        node->prev->next = node->next;
+    else
+        cache_list.head = node->next;
+    if (node->next)
+        node->next->prev = node->prev;
+    else
+        cache_list.tail = node->prev;
+
+    cache_list.total_size -= node->size;
+    cache_list.entries--;
+    free(node->vary_key);
+    free(node->hdr);
+    release_cache_body(node->body);
+    free(node);
 }
 
-int find_cache(char *uri, char* data_buf, int *size_buf ){
-    if (cache_list.head == NULL || uri == NULL) return 0;
+/*
+ * key로 캐시를 찾는다. 같은 uri라도 응답이 Vary로 지정한 요청 헤더
+ * 값(req_headers에서 고름)까지 같은 변형만 맞는 것으로 친다.
+ * 신선하면 CACHE_HIT, 만료됐지만 validator(ETag,
+ * Last-Modified)가 있어서 재검증해볼 수 있으면 CACHE_STALE, 없으면 CACHE_MISS.
+ * CACHE_REFRESH는 지금 바로 내보내도 되지만 백그라운드로 다시 받아와야 하는
+ * 경우: 자주 쓰이는데 곧 만료되거나, 만료됐어도 stale-while-revalidate 구간 안.
+ * HIT/STALE/REFRESH면 헤더와 메타데이터를 복사하고 본문은 참조를 하나 늘려서 넘긴다
+ * (호출한 쪽이 release_cache_body).
+ */
+int find_cache(const CacheKey *key, const char *req_headers, CacheObject *obj, CacheMeta *meta_buf){
+    char vary_key[MAXLINE];
+
+    if (cache_list.head == NULL || key == NULL) return CACHE_MISS;
 
     pthread_rwlock_wrlock(&cache_list.lock); // 처음부터 write 락
 
-    CacheNode *temp = cache_list.head;
-    while (temp) {
-        if (strcmp(temp->uri, uri) == 0) {
+    for (CacheNode *temp = *bucket_of(key->hash); temp; temp = temp->hnext) {
+        if (!same_key(temp, key))
+            continue;
+        select_vary_headers(temp->meta.vary, req_headers, vary_key, MAXLINE);
+        if (strcmp(temp->vary_key, vary_key) == 0) {
+            int result = CACHE_HIT;
+            time_t now = time(NULL);
+            CacheMeta *m = &temp->meta;
+            temp->hits++;
+            if (m->expires <= now) {
+                if (now < m->expires + m->swr)
+                    result = CACHE_REFRESH;
+                else if (!m->last_modified && !m->etag[0]) {
+                    //재검증할 방법이 없는 stale 응답은 자리만 비운다
+                    remove_node(temp);
+                    break;
+                } else
+                    result = CACHE_STALE;
+            } else if (temp->hits >= refresh_min_hits
+                       && (m->expires - now) * REFRESH_AHEAD <= m->expires - m->fetched)
+                result = CACHE_REFRESH;
             read_cache(temp); // LRU 갱신
-            memcpy(data_buf, temp->data, temp->size);
-            *size_buf = temp->size;
+            memcpy(obj->hdr, temp->hdr, temp->hdr_len);
+            obj->hdr_len = temp->hdr_len;
+            obj->body = temp->body;
+            __atomic_add_fetch(&temp->body->refs, 1, __ATOMIC_RELAXED);
+            *meta_buf = temp->meta;
             pthread_rwlock_unlock(&cache_list.lock);
-            return 1;
+            return result;
         }
-        temp = temp->next;
     }
     pthread_rwlock_unlock(&cache_list.lock);
-    return 0;
+    return CACHE_MISS;
+}
+
+//서버가 304 Not Modified로 답하면 본문은 그대로 두고 신선도만 갱신
+int revalidate_cache(const CacheKey *key, const char *vary_key, time_t expires){
+    CacheNode *temp;
+
+    pthread_rwlock_wrlock(&cache_list.lock);
+    if ((temp = lookup_variant(key, vary_key)) != NULL) {
+        temp->meta.expires = expires;
+        temp->meta.fetched = time(NULL);
+    }
+    pthread_rwlock_unlock(&cache_list.lock);
+    return temp != NULL;
 }
 
+//데이터 복사 없이 메타데이터만 본다 (백그라운드 갱신용)
+int peek_cache_meta(const CacheKey *key, const char *vary_key, CacheMeta *meta_buf){
+    CacheNode *temp;
+
+    pthread_rwlock_rdlock(&cache_list.lock);
+    if ((temp = lookup_variant(key, vary_key)) != NULL)
+        *meta_buf = temp->meta;
+    pthread_rwlock_unlock(&cache_list.lock);
+    return temp != NULL;
+}
 
 void read_cache(CacheNode *cache){
     //사용된 캐시를 LRU 리스트 맨 앞으로 이동하기
@@ -81,49 +210,61 @@ void read_cache(CacheNode *cache){
         cache_list.tail=cache;
 }
 
-//새 응답을 캐시에 저장함.
-void write_cache(char *uri, const char* data, int size ){
+//헤더 끝(빈 줄 다음)까지의 길이. 빈 줄이 없으면 -1
+static int header_length(const char *data, int size){
+    for (int i = 0; i + 4 <= size; i++)
+        if (!memcmp(data + i, "\r\n\r\n", 4))
+            return i + 4;
+    return -1;
+}
+
+//새 응답을 캐시에 저장함. vary_key는 이 응답을 받아온 요청의 Vary 헤더 값들.
+//헤더와 본문은 따로 저장한다 (히트 때 헤더만 고쳐 쓰고 본문은 그대로 writev)
+void write_cache(const CacheKey *key, const char *vary_key, const char* data, int size, const CacheMeta *meta){
+    CacheNode *old;
+    int hdr_len = header_length(data, size);
 
     // 모든 데이터를 다 제거한 것보다도 새 데이터가 크면 걍 버림 
-    if(size>MAX_CACHE_SIZE)
+    // 헤더가 CacheObject에 안 들어가는 응답도 저장하지 않음
+    if((size_t)size>cache_list.capacity || (size_t)size>cache_list.max_object
+       || hdr_len < 0 || hdr_len >= MAXBUF)
         return;
 
     pthread_rwlock_wrlock(&cache_list.lock); 
 
-    //캐시에 공간이 충분할 때 까지 tail에서 제거
-    while(cache_list.total_size+size>cache_list.capacity){
-        CacheNode *old_tail = cache_list.tail;
-
-        if(!old_tail) break; //캐시 비면 종료
-
-        if(old_tail->prev)
-            old_tail->prev->next=NULL;
-        cache_list.tail=old_tail->prev;
-
-        //노드가 하나뿐이었다면
-        if(cache_list.head==old_tail)
-            cache_list.head=NULL;
+    //같은 변형의 예전(stale) 응답이 남아 있으면 교체
+    if ((old = lookup_variant(key, vary_key)) != NULL)
+        remove_node(old);
 
-        cache_list.total_size-=old_tail->size;
-        free(old_tail->data);
-        free(old_tail);
-    }
-        
+    //캐시에 공간이 충분할 때 까지 tail에서 제거
+    while(cache_list.total_size+size>cache_list.capacity && cache_list.tail)
+        remove_node(cache_list.tail);
 
     CacheNode* newNode=(CacheNode*)Malloc(sizeof(CacheNode));
 
-    strncpy(newNode->uri, uri, MAXLINE-1);
-    newNode->uri[MAXLINE-1]='\0';
+    strcpy(newNode->uri, key->uri);
+    newNode->hash=key->hash;
 
-    newNode->data=malloc(size);
-    if(!newNode->data){
+    newNode->hdr=malloc(hdr_len);
+    newNode->body=malloc(sizeof(CacheBody) + size - hdr_len);
+    newNode->vary_key=strdup(vary_key);
+    if(!newNode->hdr || !newNode->body || !newNode->vary_key){
+        free(newNode->hdr);
+        free(newNode->body);
+        free(newNode->vary_key);
         free(newNode);
         pthread_rwlock_unlock(&cache_list.lock); 
         return;
     }
 
-    memcpy(newNode->data, data,size);
+    memcpy(newNode->hdr, data, hdr_len);
+    newNode->hdr_len=hdr_len;
+    newNode->body->refs=1;
+    newNode->body->len=size-hdr_len;
+    memcpy(newNode->body->data, data+hdr_len, size-hdr_len);
     newNode->size=size;
+    newNode->meta=*meta;
+    newNode->hits=0;
     newNode->prev=NULL;
     newNode->next=cache_list.head;
     if(cache_list.head)
@@ -131,8 +272,11 @@ void write_cache(char *uri, const char* data, int size ){
     cache_list.head=newNode;
     if(cache_list.tail==NULL)
         cache_list.tail=newNode;
+    newNode->hnext=*bucket_of(key->hash);
+    *bucket_of(key->hash)=newNode;
 
     cache_list.total_size+=size;
+    cache_list.entries++;
 
     pthread_rwlock_unlock(&cache_list.lock); 
 
@@ -153,4 +297,341 @@ void debug_print_cache() {
     printf("========== End of Cache =========\n");
 
     pthread_rwlock_unlock(&cache_list.lock);
-}
\ No newline at end of file
+}
+
+/*
+ * 크기(by_hits면 조회 수)가 큰 순서로 최대 n개를 out에 채우고 개수를 돌려준다.
+ * 버킷을 CACHE_SCAN_BATCH개씩 나눠서 락을 짧게 잡고 훑으므로 그 사이 바뀐 엔트리는
+ * 빠지거나 두 번 보일 수 있다 (관리용 요약이라 괜찮음).
+ */
+int cache_top(CacheEntryInfo *out, int n, int by_hits){
+    int count = 0;
+
+    for (int b = 0; b < CACHE_BUCKETS; b += CACHE_SCAN_BATCH) {
+        pthread_rwlock_rdlock(&cache_list.lock);
+        for (int i = b; i < b + CACHE_SCAN_BATCH; i++) {
+            for (CacheNode *node = cache_list.buckets[i]; node; node = node->hnext) {
+                unsigned long v = by_hits ? node->hits : node->size;
+                int pos = count;
+                // 삽입 정렬: n이 작으니 충분
+                while (pos > 0 && (by_hits ? out[pos - 1].hits : out[pos - 1].size) < v)
+                    pos--;
+                if (pos >= n)
+                    continue;
+                if (count < n)
+                    count++;
+                memmove(&out[pos + 1], &out[pos], (count - 1 - pos) * sizeof(*out));
+                snprintf(out[pos].uri, CACHE_INFO_URI, "%.*s", CACHE_INFO_URI - 1, node->uri);
+                out[pos].size = node->size;
+                out[pos].hits = node->hits;
+                out[pos].expires = node->meta.expires;
+            }
+        }
+        pthread_rwlock_unlock(&cache_list.lock);
+    }
+    return count;
+}
+
+/*
+ * uri의 모든 변형을 캐시에서 지운다. prefix면 그 문자열로 시작하는 키 전부
+ * (버킷을 나눠서 훑음). uri는 캐시 키처럼 정규화해서 비교한다. 지운 개수를 돌려줌
+ */
+int cache_purge(const char *uri, int prefix){
+    CacheKey key;
+    CacheNode *node, *next;
+    size_t len;
+    int removed = 0;
+
+    make_cache_key(&key, uri);
+    if (!prefix) {
+        pthread_rwlock_wrlock(&cache_list.lock);
+        for (node = *bucket_of(key.hash); node; node = next) {
+            next = node->hnext;
+            if (same_key(node, &key)) {
+                remove_node(node);
+                removed++;
+            }
+        }
+        pthread_rwlock_unlock(&cache_list.lock);
+        return removed;
+    }
+    len = strlen(key.uri);
+    for (int b = 0; b < CACHE_BUCKETS; b += CACHE_SCAN_BATCH) {
+        pthread_rwlock_wrlock(&cache_list.lock);
+        for (int i = b; i < b + CACHE_SCAN_BATCH; i++) {
+            for (node = cache_list.buckets[i]; node; node = next) {
+                next = node->hnext;
+                if (!strncmp(node->uri, key.uri, len)) {
+                    remove_node(node);
+                    removed++;
+                }
+            }
+        }
+        pthread_rwlock_unlock(&cache_list.lock);
+    }
+    return removed;
+}
+
+/*
+ * 용량과 최대 오브젝트 크기를 바꾼다 (0이면 그대로). 넘치는 만큼은 LRU 꼬리부터,
+ * 새 최대 크기보다 큰 엔트리는 버킷을 나눠 훑으며 조금씩 내보낸다.
+ * 내보낸 개수를 돌려줌
+ */
+int cache_set_limits(size_t capacity, size_t max_object){
+    int evicted = 0, n;
+
+    pthread_rwlock_wrlock(&cache_list.lock);
+    if (capacity)
+        cache_list.capacity = capacity;
+    if (max_object)
+        cache_list.max_object = max_object;
+    pthread_rwlock_unlock(&cache_list.lock);
+
+    do {
+        pthread_rwlock_wrlock(&cache_list.lock);
+        for (n = 0; n < CACHE_EVICT_BATCH && cache_list.tail
+             && cache_list.total_size > cache_list.capacity; n++)
+            remove_node(cache_list.tail);
+        pthread_rwlock_unlock(&cache_list.lock);
+        evicted += n;
+    } while (n == CACHE_EVICT_BATCH);
+
+    if (max_object) {
+        for (int b = 0; b < CACHE_BUCKETS; b += CACHE_SCAN_BATCH) {
+            pthread_rwlock_wrlock(&cache_list.lock);
+            for (int i = b; i < b + CACHE_SCAN_BATCH; i++) {
+                CacheNode *node, *next;
+                for (node = cache_list.buckets[i]; node; node = next) {
+                    next = node->hnext;
+                    if (node->size > cache_list.max_object) {
+                        remove_node(node);
+                        evicted++;
+                    }
+                }
+            }
+            pthread_rwlock_unlock(&cache_list.lock);
+        }
+    }
+    return evicted;
+}
+
+void cache_summary(size_t *entries, size_t *bytes, size_t *capacity, size_t *max_object){
+    pthread_rwlock_rdlock(&cache_list.lock);
+    *entries = cache_list.entries;
+    *bytes = cache_list.total_size;
+    *capacity = cache_list.capacity;
+    *max_object = cache_list.max_object;
+    pthread_rwlock_unlock(&cache_list.lock);
+}
+
+/* 스냅샷에 쓸 엔트리 하나: 락 밖에서 쓰려고 떼어 온 사본 (본문은 참조) */
+typedef struct {
+    char *uri, *vary_key, *hdr;
+    size_t hdr_len;
+    CacheBody *body;
+    CacheMeta meta;
+    unsigned long hits;
+} SnapEntry;
+
+static void free_snap_entries(SnapEntry *e, size_t n){
+    for (size_t i = 0; i < n; i++) {
+        free(e[i].uri);
+        free(e[i].vary_key);
+        free(e[i].hdr);
+        release_cache_body(e[i].body);
+    }
+    free(e);
+}
+
+/*
+ * 캐시 전체를 path에 스냅샷으로 쓴다. 락은 LRU 순서대로 엔트리를 떼어 오는 동안만
+ * (읽기 락, 본문은 참조만 늘림) 잡고, 파일 쓰기는 락 밖에서 한다.
+ * path.tmp에 다 쓴 뒤 rename하므로 중간에 죽어도 예전 스냅샷은 남는다.
+ * 재검증할 수 없는 만료 엔트리는 뺀다. 쓴 엔트리 수, 실패하면 -1
+ */
+int cache_save_snapshot(const char *path){
+    char tmp[MAXLINE];
+    CacheSnapHeader h;
+    SnapEntry *e;
+    size_t n = 0;
+    time_t now = time(NULL);
+    FILE *fp;
+    int fd, ok;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp))
+        return -1;
+    pthread_rwlock_rdlock(&cache_list.lock);
+    if ((e = malloc((cache_list.entries + 1) * sizeof(SnapEntry))) == NULL) {
+        pthread_rwlock_unlock(&cache_list.lock);
+        return -1;
+    }
+    for (CacheNode *node = cache_list.head; node; node = node->next) {
+        if (node->meta.expires + node->meta.swr <= now
+            && !node->meta.last_modified && !node->meta.etag[0])
+            continue;
+        e[n].uri = strdup(node->uri);
+        e[n].vary_key = strdup(node->vary_key);
+        e[n].hdr = malloc(node->hdr_len);
+        e[n].body = node->body;
+        __atomic_add_fetch(&node->body->refs, 1, __ATOMIC_RELAXED);
+        if (e[n].hdr)
+            memcpy(e[n].hdr, node->hdr, node->hdr_len);
+        e[n].hdr_len = node->hdr_len;
+        e[n].meta = node->meta;
+        e[n].hits = node->hits;
+        n++;
+        if (!e[n - 1].uri || !e[n - 1].vary_key || !e[n - 1].hdr) {
+            pthread_rwlock_unlock(&cache_list.lock);
+            free_snap_entries(e, n);
+            return -1;
+        }
+    }
+    pthread_rwlock_unlock(&cache_list.lock);
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) < 0
+        || (fp = fdopen(fd, "w")) == NULL) {
+        if (fd >= 0)
+            close(fd);
+        free_snap_entries(e, n);
+        return -1;
+    }
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CACHE_SNAP_MAGIC, sizeof(h.magic));
+    h.version = CACHE_SNAP_VERSION;
+    h.meta_size = sizeof(CacheMeta);
+    h.entries = n;
+    h.saved = now;
+    ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    for (size_t i = 0; ok && i < n; i++) {
+        CacheSnapRecord r;
+        memset(&r, 0, sizeof(r));
+        r.uri_len = strlen(e[i].uri);
+        r.vary_len = strlen(e[i].vary_key);
+        r.hdr_len = e[i].hdr_len;
+        r.body_len = e[i].body->len;
+        r.hits = e[i].hits;
+        r.meta = e[i].meta;
+        ok = fwrite(&r, sizeof(r), 1, fp) == 1
+             && fwrite(e[i].uri, 1, r.uri_len, fp) == r.uri_len
+             && fwrite(e[i].vary_key, 1, r.vary_len, fp) == r.vary_len
+             && fwrite(e[i].hdr, 1, r.hdr_len, fp) == r.hdr_len
+             && fwrite(e[i].body->data, 1, r.body_len, fp) == r.body_len;
+    }
+    free_snap_entries(e, n);
+    ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0 && ok;
+    if (fclose(fp) != 0 || !ok || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return n;
+}
+
+/*
+ * path의 스냅샷을 mmap해서 캐시에 한꺼번에 넣는다 (시작할 때, 요청을 받기 전).
+ * 레코드는 LRU 꼬리 쪽에 차례로 붙이고, 지금 용량/최대 크기를 넘거나 이미 있는
+ * 변형은 건너뛴다. 넣은 엔트리 수, 파일이 없거나 형식이 다르면 -1
+ */
+int cache_load_snapshot(const char *path){
+    struct stat st;
+    CacheSnapHeader h;
+    CacheSnapRecord r;
+    CacheKey key;
+    char *map, *p, *end;
+    int fd, loaded = 0;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(h)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    memcpy(&h, map, sizeof(h));
+    if (memcmp(h.magic, CACHE_SNAP_MAGIC, sizeof(h.magic)) || h.version != CACHE_SNAP_VERSION
+        || h.meta_size != sizeof(CacheMeta)) {
+        munmap(map, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    p = map + sizeof(h);
+    end = map + st.st_size;
+    pthread_rwlock_wrlock(&cache_list.lock);
+    for (uint64_t i = 0; i < h.entries; i++) {
+        size_t size;
+        CacheNode *node;
+        char vary_key[MAXLINE], *hdr, *body;
+
+        //레코드는 정렬돼 있지 않으므로 복사해서 읽는다
+        if ((size_t)(end - p) < sizeof(r))
+            break;
+        memcpy(&r, p, sizeof(r));
+        p += sizeof(r);
+        if (r.uri_len >= MAXLINE || r.vary_len >= MAXLINE || r.hdr_len >= MAXBUF
+            || r.body_len > (uint64_t)(end - p)
+            || (size_t)(end - p) - r.body_len < (size_t)r.uri_len + r.vary_len + r.hdr_len)
+            break; //잘린 파일
+        size = r.hdr_len + r.body_len;
+        memcpy(key.uri, p, r.uri_len);
+        key.uri[r.uri_len] = '\0';
+        key.hash = uri_hash(key.uri); //저장할 때 이미 정규화된 키 (다시 정규화하면 입력과 출력이 겹침)
+        memcpy(vary_key, p + r.uri_len, r.vary_len);
+        vary_key[r.vary_len] = '\0';
+        hdr = p + r.uri_len + r.vary_len;
+        body = hdr + r.hdr_len;
+        p = body + r.body_len;
+
+        if (size > cache_list.max_object || cache_list.total_size + size > cache_list.capacity)
+            continue;
+        if (lookup_variant(&key, vary_key))
+            continue;
+
+        if ((node = malloc(sizeof(CacheNode))) == NULL)
+            break;
+        node->hdr = malloc(r.hdr_len);
+        node->body = malloc(sizeof(CacheBody) + r.body_len);
+        node->vary_key = strdup(vary_key);
+        if (!node->hdr || !node->body || !node->vary_key) {
+            free(node->hdr);
+            free(node->body);
+            free(node->vary_key);
+            free(node);
+            break;
+        }
+        strcpy(node->uri, key.uri);
+        node->hash = key.hash;
+        memcpy(node->hdr, hdr, r.hdr_len);
+        node->hdr_len = r.hdr_len;
+        node->body->refs = 1;
+        node->body->len = r.body_len;
+        memcpy(node->body->data, body, r.body_len);
+        node->size = size;
+        node->meta = r.meta;
+        //파일에서 온 문자열이라 끝이 NUL이라는 보장이 없다
+        node->meta.etag[CACHE_ETAG_LEN - 1] = '\0';
+        node->meta.vary[HTTP_VARY_LEN - 1] = '\0';
+        node->hits = r.hits;
+
+        //LRU 꼬리에 붙인다 (파일이 최근 것부터라 순서 유지)
+        node->next = NULL;
+        node->prev = cache_list.tail;
+        if (cache_list.tail)
+            cache_list.tail->next = node;
+        else
+            cache_list.head = node;
+        cache_list.tail = node;
+        node->hnext = *bucket_of(key.hash);
+        *bucket_of(key.hash) = node;
+        cache_list.total_size += size;
+        cache_list.entries++;
+        loaded++;
+    }
+    pthread_rwlock_unlock(&cache_list.lock);
+    munmap(map, st.st_size);
+    return loaded;
+}
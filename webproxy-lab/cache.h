@@ -2,19 +2,77 @@
 #include <stdlib.h>
 #include <strings.h>
 #include <pthread.h>
+#include <time.h>
+#include <stdint.h>
 #include "csapp.h"
+#include "http.h"
 
 /* Recommended max cache and object sizes */
 #define MAX_CACHE_SIZE 1049000
 #define MAX_OBJECT_SIZE 102400
 
+#define CACHE_ETAG_LEN 128
+#define CACHE_BUCKETS 1024 //해시 버킷 수 (2의 거듭제곱)
+#define CACHE_SCAN_BATCH 64 //관리 명령이 락을 한 번 잡고 훑는 버킷 수 (요청 처리를 오래 막지 않게)
+#define CACHE_EVICT_BATCH 64 //용량을 줄일 때 락을 한 번 잡고 내보내는 최대 노드 수
+#define CACHE_INFO_URI 256 //목록에 보여줄 uri 길이
+
+/* find_cache 결과 */
+enum { CACHE_MISS, CACHE_HIT, CACHE_STALE, CACHE_REFRESH };
+
+/* 이 정도 이상 조회된 오브젝트가 수명의 마지막 1/REFRESH_AHEAD 구간에 들어오면
+   만료 전에 백그라운드로 미리 다시 받아둔다 */
+#define REFRESH_MIN_HITS 2
+#define REFRESH_AHEAD 10
+extern int refresh_min_hits; //설정(refresh_min_hits)으로 바뀌는 값, 기본은 REFRESH_MIN_HITS
+
+/* 신선도 + 재검증(conditional request)에 쓰는 메타데이터 */
+typedef struct _CacheMeta{
+    time_t expires; //이 시각이 지나면 stale -> 재검증 전에는 서빙하지 않음
+    time_t last_modified; //Last-Modified (없으면 0)
+    char etag[CACHE_ETAG_LEN]; //ETag (없으면 빈 문자열)
+    time_t fetched; //원 서버에서 받아온(또는 재검증한) 시각
+    long swr; //만료 뒤에도 이만큼(초)은 stale을 내보내면서 백그라운드 갱신 가능
+    char vary[HTTP_VARY_LEN]; //응답의 Vary 헤더 이름들 (select_vary_headers 형식)
+} CacheMeta;
+
+/* 정규화된 uri와 그 해시. 요청마다 한 번 만들어서 조회/저장에 같이 쓴다 */
+typedef struct _CacheKey{
+    char uri[MAXLINE];
+    unsigned long hash;
+} CacheKey;
+
+/*
+ * 캐시된 응답 본문. 히트마다 복사하지 않고 보내는 요청들이 같이 쓰므로 참조 수로 관리한다.
+ * 노드가 캐시에서 빠져도 보내는 중인 요청이 놓을 때까지는 남아 있음
+ */
+typedef struct _CacheBody{
+    int refs; //캐시 노드 1 + 보내는 중인 요청 수 (atomic)
+    size_t len;
+    char data[];
+} CacheBody;
+
+/* find_cache가 넘겨주는 사본: 헤더는 요청마다 고쳐 쓰므로 복사, 본문은 참조 */
+typedef struct _CacheObject{
+    char hdr[MAXBUF]; //상태 줄부터 빈 줄까지
+    int hdr_len;
+    CacheBody *body; //다 쓰면 release_cache_body (없으면 NULL)
+} CacheObject;
+
 typedef struct _CacheNode{
-    char uri[MAXLINE]; //캐시 키
-    char *data; //캐시 데이터 (웹 오브젝트)
-    size_t size;
+    char uri[MAXLINE]; //캐시 키 (정규화된 uri)
+    unsigned long hash;
+    char *vary_key; //Vary에 적힌 요청 헤더 값들 (같은 uri의 변형 구분용, 없으면 "")
+    char *hdr; //응답 헤더 (상태 줄부터 빈 줄까지)
+    size_t hdr_len;
+    CacheBody *body; //응답 본문
+    size_t size; //hdr_len + 본문 길이 (캐시 용량 계산용)
+    CacheMeta meta;
+    unsigned long hits; //조회 횟수 (백그라운드 갱신 대상 판단용)
     
     struct _CacheNode *next;
     struct _CacheNode *prev;
+    struct _CacheNode *hnext; //같은 해시 버킷의 다음 노드
 } CacheNode;
 
 typedef struct _CacheList{
@@ -22,13 +80,59 @@ typedef struct _CacheList{
     CacheNode *tail; //가장 마지막으로 사용한 노드
     size_t total_size; //전체 캐시 사용량
     size_t capacity; //최대 캐시 용량
+    size_t max_object; //이보다 큰 응답은 저장하지 않음
+    size_t entries; //노드 수
     pthread_rwlock_t lock; //보호용 락 
+    CacheNode *buckets[CACHE_BUCKETS]; //hash % CACHE_BUCKETS -> 노드 체인
 }CacheList;
 
 
 void init_cache();
 void deinit_cache();
-int find_cache(char *uri, char* data_buf, int *size_buf);
+void make_cache_key(CacheKey *key, const char *uri);
+int find_cache(const CacheKey *key, const char *req_headers, CacheObject *obj, CacheMeta *meta_buf);
+void release_cache_body(CacheBody *body);
 void read_cache(CacheNode *cache);
-void write_cache(char *uri, const char* data, int size);
-void debug_print_cache();
\ No newline at end of file
+void write_cache(const CacheKey *key, const char *vary_key, const char* data, int size, const CacheMeta *meta);
+int revalidate_cache(const CacheKey *key, const char *vary_key, time_t expires);
+int peek_cache_meta(const CacheKey *key, const char *vary_key, CacheMeta *meta_buf);
+void debug_print_cache();
+
+/* 관리 채널(admin.c)이 보는 엔트리 요약 */
+typedef struct _CacheEntryInfo{
+    char uri[CACHE_INFO_URI]; //길면 잘림
+    size_t size;
+    unsigned long hits;
+    time_t expires;
+} CacheEntryInfo;
+
+int cache_top(CacheEntryInfo *out, int n, int by_hits);
+int cache_purge(const char *uri, int prefix);
+int cache_set_limits(size_t capacity, size_t max_object);
+void cache_summary(size_t *entries, size_t *bytes, size_t *capacity, size_t *max_object);
+
+/*
+ * 캐시 스냅샷 파일 (재시작해도 캐시를 데워 둔 채로 시작하려고).
+ * CacheSnapHeader 다음에 엔트리마다 CacheSnapRecord와 uri, vary_key, 헤더, 본문이
+ * 빈틈 없이 이어진다. 엔트리는 LRU 앞(최근)부터라 읽을 때 꼬리에 붙이면 순서가 그대로고,
+ * 용량이 모자라면 덜 쓰인 쪽이 빠진다. 같은 빌드끼리만 읽음 (meta_size로 확인)
+ */
+#define CACHE_SNAP_MAGIC "WPCACHE1"
+#define CACHE_SNAP_VERSION 1
+
+typedef struct _CacheSnapHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t meta_size; //sizeof(CacheMeta)
+    uint64_t entries;
+    int64_t saved; //저장한 시각
+} CacheSnapHeader;
+
+typedef struct _CacheSnapRecord{
+    uint32_t uri_len, vary_len, hdr_len, pad;
+    uint64_t body_len, hits;
+    CacheMeta meta;
+} CacheSnapRecord;
+
+int cache_save_snapshot(const char *path);
+int cache_load_snapshot(const char *path);
@@ -0,0 +1,89 @@
+#!/bin/bash
+#
+# cgibench.sh - CGI benchmark for tiny. Runs the same dynamic workload
+#     against tiny in the one-process-per-request mode (posix_spawn), with
+#     persistent CGI workers (tiny -c N) and with the CGI response cache,
+#     and appends one row per mode to the results file in the same format
+#     as bench.sh.
+#
+#     usage: ./cgibench.sh [results-file]  (default: bench_results.tsv)
+#     env:   BENCH_SECS   seconds per workload (default 5)
+#            BENCH_CONNS  concurrent connections (default 8)
+#            CGI_WORKERS  workers per script in pool mode (default 4)
+#
+
+set -f    # URIs like /cgi-bin/adder?x=1&y=2 must not be globbed
+HOME_DIR=`pwd`
+RESULTS=${1:-bench_results.tsv}
+SECS=${BENCH_SECS:-5}
+CONNS=${BENCH_CONNS:-8}
+WORKERS=${CGI_WORKERS:-4}
+TIMEOUT_MS=1000
+
+# tiny modes: "<name>|<extra tiny flags>"
+# adder sends Cache-Control: max-age, so the first two turn the cache off.
+MODES=("cgi-spawn|-m 0"
+       "cgi-pool|-m 0 -c ${WORKERS}"
+       "cgi-cache|")
+
+URIS="/cgi-bin/adder?x=1&y=2 /cgi-bin/adder?x=30&y=12"
+
+function free_port {
+    bash ./free-port.sh
+}
+
+function wait_for_port_use {
+    for i in `seq 50`
+    do
+        netstat --numeric-ports --numeric-hosts -ltn | grep -q ":${1} " && return
+        sleep 0.1
+    done
+    echo "Error: nothing is listening on port ${1}"
+    cleanup
+    exit 1
+}
+
+function cleanup {
+    kill ${tiny_pid} 2> /dev/null
+}
+
+for prog in ./loadgen ./tiny/tiny ./tiny/cgi-bin/adder
+do
+    if [ ! -x ${prog} ]
+    then
+        echo "Error: ${prog} not found. Run 'make cgibench' to build everything."
+        exit 1
+    fi
+done
+
+trap 'cleanup; exit 1' INT TERM
+killall -q tiny 2> /dev/null
+commit=`git rev-parse --short HEAD 2> /dev/null || echo unknown`
+
+if [ ! -s ${RESULTS} ]
+then
+    printf "commit\tconfig\tworkload\trequests\terrors\tsecs\trps\tmbps\tp50_us\tp99_us\tp999_us\tmax_us\n" > ${RESULTS}
+fi
+
+echo "${SECS}s x ${CONNS} conns per mode"
+for mode in "${MODES[@]}"
+do
+    name=${mode%%|*}
+    flags=${mode#*|}
+    tiny_port=$(free_port)
+    cd ./tiny
+    ./tiny ${flags} ${tiny_port} &> /dev/null &
+    tiny_pid=$!
+    cd ${HOME_DIR}
+    wait_for_port_use ${tiny_port}
+
+    row=`./loadgen -m -d ${SECS} -c ${CONNS} -t ${TIMEOUT_MS} -z 0 localhost ${tiny_port} ${URIS}`
+    printf "%s\t%s\t%s\t%s\n" "${commit}" "tiny" "${name}" "${row}" >> ${RESULTS}
+    printf "  %-10s %s\n" "${name}" "${row}"
+
+    # pool workers exit on their own once they see EOF from tiny
+    kill ${tiny_pid} 2> /dev/null
+    wait ${tiny_pid} 2> /dev/null
+done
+
+echo "Results appended to ${RESULTS}"
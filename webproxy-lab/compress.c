@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "compress.h"
+#include "stats.h"
+
+#define GZIP_CHUNK 8192
+
+int gzip_level = GZIP_DEFAULT_LEVEL;
+
+/* 압축해서 이득이 있는 타입들 (이미지/동영상은 이미 압축돼 있음) */
+static const char *compressible_types[] = {
+    "text/", "application/javascript", "application/json",
+    "application/xml", "image/svg+xml", NULL
+};
+
+//프록시가 이 응답을 gzip으로 바꿔 보내도 되는지
+int gzip_applicable(const HttpResponse *resp){
+    if (gzip_level <= 0 || resp->status != 200 || resp->encoded || resp->no_transform)
+        return 0;
+    // 캐시 변형을 구분할 "accept-encoding,"을 Vary 목록에 붙일 자리가 있어야 함
+    if (!strstr(resp->vary, "accept-encoding,") && strlen(resp->vary) + 17 > HTTP_VARY_LEN - 1)
+        return 0;
+    for (const char **t = compressible_types; *t; t++)
+        if (!strncasecmp(resp->content_type, *t, strlen(*t)))
+            return 1;
+    return 0;
+}
+
+/*
+ * 원래 응답 헤더(hdrs, resp->header_len 바이트)를 gzip 본문에 맞게 고쳐
+ * out에 쓴다. Content-Length는 빼고(clen >= 0이면 그 값으로 다시 씀),
+ * Content-Encoding: gzip과 Vary: Accept-Encoding을 붙인다.
+ * 쓴 길이를 돌려주고, out이 모자라면 -1.
+ */
+int gzip_rewrite_headers(const char *hdrs, const HttpResponse *resp, long clen, char *out, size_t outlen){
+    const char *line, *next, *end = hdrs + resp->header_len - 2;
+    size_t n = 0;
+
+    if ((size_t)resp->header_len + 128 > outlen)
+        return -1;
+    for (line = hdrs; line < end; line = next) {
+        next = strstr(line, "\r\n") + 2;
+        if (!strncasecmp(line, "Content-Length:", 15))
+            continue;
+        memcpy(out + n, line, next - line);
+        n += next - line;
+    }
+    n += sprintf(out + n, "Content-Encoding: gzip\r\n");
+    if (!strstr(resp->vary, "accept-encoding,"))
+        n += sprintf(out + n, "Vary: Accept-Encoding\r\n");
+    if (clen >= 0)
+        n += sprintf(out + n, "Content-Length: %ld\r\n", clen);
+    n += sprintf(out + n, "\r\n");
+    return n;
+}
+
+int gzip_begin(GzipStream *gz, gzip_sink_fn sink, void *arg){
+    memset(gz, 0, sizeof(*gz));
+    gz->sink = sink;
+    gz->arg = arg;
+    // windowBits 15 + 16: zlib 헤더 대신 gzip 헤더/트레일러
+    return deflateInit2(&gz->zs, gzip_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK ? 0 : -1;
+}
+
+//flush 모드로 입력을 다 밀어넣고 나온 출력을 sink로 보낸다
+static int gzip_run(GzipStream *gz, const char *buf, size_t len, int flush){
+    char out[GZIP_CHUNK];
+    uint64_t t0;
+    int rc;
+
+    gz->zs.next_in = (Bytef *)buf;
+    gz->zs.avail_in = len;
+    do {
+        gz->zs.next_out = (Bytef *)out;
+        gz->zs.avail_out = sizeof(out);
+        t0 = thread_cpu_ns(); // sink(소켓 쓰기)는 빼고 deflate만 잰다
+        rc = deflate(&gz->zs, flush);
+        gz->cpu_ns += thread_cpu_ns() - t0;
+        if (rc == Z_STREAM_ERROR)
+            return -1;
+        if (sizeof(out) - gz->zs.avail_out > 0)
+            gz->sink(gz->arg, out, sizeof(out) - gz->zs.avail_out);
+    } while (gz->zs.avail_out == 0 || (flush == Z_FINISH && rc != Z_STREAM_END));
+    return 0;
+}
+
+//원 서버에서 받은 본문 한 덩어리. Z_SYNC_FLUSH로 지금까지 받은 만큼은 바로 내보낸다
+int gzip_feed(GzipStream *gz, const char *buf, size_t len){
+    return len ? gzip_run(gz, buf, len, Z_SYNC_FLUSH) : 0;
+}
+
+//남은 출력과 gzip 트레일러를 내보내고 통계에 더한다
+int gzip_end(GzipStream *gz){
+    int rc = gzip_run(gz, NULL, 0, Z_FINISH);
+
+    STAT_ADD(gzip_responses, 1);
+    STAT_ADD(gzip_in_bytes, gz->zs.total_in);
+    STAT_ADD(gzip_out_bytes, gz->zs.total_out);
+    STAT_ADD(gzip_cpu_ns, gz->cpu_ns);
+    deflateEnd(&gz->zs);
+    return rc;
+}
+
+void gzip_buffer_sink(void *arg, const char *buf, size_t len){
+    GzipBuffer *b = arg;
+
+    if (b->overflow || b->len + len > b->cap) {
+        b->overflow = 1;
+        return;
+    }
+    memcpy(b->buf + b->len, buf, len);
+    b->len += len;
+}
@@ -0,0 +1,42 @@
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+#include "http.h"
+
+/* 기본 압축 레벨 (1: 빠름 ~ 9: 작음). 0이면 프록시가 압축하지 않음 */
+#define GZIP_DEFAULT_LEVEL 6
+
+extern int gzip_level;
+
+/* 압축된 출력을 받아갈 곳. 클라이언트 소켓으로 쓰거나 캐시 버퍼에 모은다 */
+typedef void (*gzip_sink_fn)(void *arg, const char *buf, size_t len);
+
+/*
+ * 본문을 받는 대로 조금씩 deflate해서 sink로 넘기는 스트림.
+ * 원 서버에서 다음 덩어리를 기다리는 동안 이미 압축된 앞부분이 나간다.
+ */
+typedef struct _GzipStream{
+    z_stream zs;
+    gzip_sink_fn sink;
+    void *arg;
+    uint64_t cpu_ns;
+} GzipStream;
+
+/* 고정 크기 버퍼에 모으는 sink. 넘치면 overflow만 세우고 버린다 */
+typedef struct _GzipBuffer{
+    char *buf;
+    size_t len, cap;
+    int overflow;
+} GzipBuffer;
+
+int gzip_applicable(const HttpResponse *resp);
+int gzip_rewrite_headers(const char *hdrs, const HttpResponse *resp, long clen, char *out, size_t outlen);
+int gzip_begin(GzipStream *gz, gzip_sink_fn sink, void *arg);
+int gzip_feed(GzipStream *gz, const char *buf, size_t len);
+int gzip_end(GzipStream *gz);
+void gzip_buffer_sink(void *arg, const char *buf, size_t len);
+
+#endif /* __COMPRESS_H__ */
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "config.h"
+#include "cache.h"
+#include "compress.h"
+#include "refresh.h"
+#include "iouring.h"
+#include "http.h"
+
+void config_defaults(ProxyConfig *cfg){
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->cache_size = MAX_CACHE_SIZE;
+    cfg->max_object_size = MAX_OBJECT_SIZE;
+    cfg->gzip_level = GZIP_DEFAULT_LEVEL;
+    cfg->engine = IO_SYNC;
+    cfg->refresh_workers = REFRESH_WORKERS;
+    cfg->drain_timeout = DRAIN_TIMEOUT;
+    cfg->default_ttl = HTTP_DEFAULT_TTL;
+    cfg->refresh_min_hits = REFRESH_MIN_HITS;
+}
+
+//"64M" 같은 크기. 숫자가 아니거나 0이면 -1
+static int parse_size(const char *s, size_t *out){
+    char *end;
+    unsigned long long v = strtoull(s, &end, 10);
+
+    switch (toupper((unsigned char)*end)) {
+    case 'G': v <<= 10; /* fall through */
+    case 'M': v <<= 10; /* fall through */
+    case 'K': v <<= 10; end++; break;
+    }
+    if (end == s || *end != '\0' || v == 0)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+static int parse_int(const char *s, int *out){
+    char *end;
+    long v = strtol(s, &end, 10);
+
+    if (end == s || *end != '\0' || v < 0)
+        return -1;
+    *out = v;
+    return 0;
+}
+
+static int copy_str(char *dst, const char *s){
+    if (strlen(s) >= CONFIG_PATH_LEN)
+        return -1;
+    strcpy(dst, s);
+    return 0;
+}
+
+/* key 하나를 설정한다. 모르는 key거나 값이 이상하면 -1 */
+int config_set(ProxyConfig *cfg, const char *key, const char *value){
+    if (!strcmp(key, "cache_size"))
+        return parse_size(value, &cfg->cache_size);
+    if (!strcmp(key, "max_object_size"))
+        return parse_size(value, &cfg->max_object_size);
+    if (!strcmp(key, "gzip_level"))
+        return parse_int(value, &cfg->gzip_level) < 0 || cfg->gzip_level > 9 ? -1 : 0;
+    if (!strcmp(key, "workers"))
+        return parse_int(value, &cfg->workers);
+    if (!strcmp(key, "pin_cpus"))
+        return parse_int(value, &cfg->pin_cpus);
+    if (!strcmp(key, "coroutines"))
+        return parse_int(value, &cfg->coroutines);
+    if (!strcmp(key, "refresh_workers"))
+        return parse_int(value, &cfg->refresh_workers);
+    if (!strcmp(key, "drain_timeout"))
+        return parse_int(value, &cfg->drain_timeout);
+    if (!strcmp(key, "default_ttl"))
+        return parse_int(value, &cfg->default_ttl);
+    if (!strcmp(key, "stale_while_revalidate"))
+        return parse_int(value, &cfg->default_swr);
+    if (!strcmp(key, "refresh_min_hits"))
+        return parse_int(value, &cfg->refresh_min_hits);
+    if (!strcmp(key, "engine")) {
+        if (!strcmp(value, "sync"))
+            cfg->engine = IO_SYNC;
+        else if (!strcmp(value, "uring"))
+            cfg->engine = IO_URING;
+        else
+            return -1;
+        return 0;
+    }
+    if (!strcmp(key, "sockopts"))
+        return copy_str(cfg->sockopts, value);
+    if (!strcmp(key, "accesslog"))
+        return copy_str(cfg->accesslog, value);
+    if (!strcmp(key, "admin_socket"))
+        return copy_str(cfg->admin_socket, value);
+    if (!strcmp(key, "cache_snapshot"))
+        return copy_str(cfg->cache_snapshot, value);
+    return -1;
+}
+
+static char *trim(char *s){
+    char *end;
+
+    while (isspace((unsigned char)*s))
+        s++;
+    end = s + strlen(s);
+    while (end > s && isspace((unsigned char)end[-1]))
+        *--end = '\0';
+    return s;
+}
+
+/*
+ * 설정 파일을 읽어 cfg에 덮어쓴다. 잘못된 줄은 줄 번호와 함께 stderr에 알리고
+ * -1 (그때까지 읽은 값은 cfg에 남아 있으므로 호출한 쪽이 버릴지 정함)
+ */
+int config_load(ProxyConfig *cfg, const char *path){
+    FILE *fp;
+    char line[1024], *key, *value, *eq;
+    int lineno = 0, ret = 0;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+        fprintf(stderr, "config: cannot open %s\n", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp)) {
+        lineno++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        key = trim(line);
+        if (*key == '\0')
+            continue;
+        if ((eq = strchr(key, '=')) == NULL) {
+            fprintf(stderr, "config: %s:%d: expected key = value\n", path, lineno);
+            ret = -1;
+            continue;
+        }
+        *eq = '\0';
+        key = trim(key);
+        value = trim(eq + 1);
+        if (config_set(cfg, key, value) < 0) {
+            fprintf(stderr, "config: %s:%d: bad setting %s = %s\n", path, lineno, key, value);
+            ret = -1;
+        }
+    }
+    fclose(fp);
+    return ret;
+}
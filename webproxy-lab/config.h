@@ -0,0 +1,41 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <stddef.h>
+
+/*
+ * 프록시 설정. 기본값 <- 설정 파일(-f) <- 명령행(-D key=value와 기존 플래그) 순서로 덮어쓴다.
+ * 파일 형식은 한 줄에 "key = value", '#' 뒤는 주석. 크기에는 K/M/G를 붙일 수 있음.
+ * SIGHUP을 받으면 다시 읽는데, 바로 바뀌는 건 cache_size, max_object_size,
+ * gzip_level, drain_timeout과 캐시 정책(default_ttl, stale_while_revalidate,
+ * refresh_min_hits)뿐이고 나머지는 재시작해야 적용된다.
+ * (MAXLINE, MAXBUF, RIO_BUFSIZE는 구조체 안 배열 크기라 여전히 컴파일 시간 상수)
+ */
+#define CONFIG_PATH_LEN 256
+#define CONFIG_MAX_OVERRIDES 64
+#define DRAIN_TIMEOUT 30 //종료할 때 처리 중인 요청을 기다리는 최대 초
+
+typedef struct _ProxyConfig{
+    size_t cache_size;      // 캐시 용량 (바로 바뀜)
+    size_t max_object_size; // 저장할 최대 응답 = 요청별 버퍼 크기 (줄이기만 바로 바뀜)
+    int gzip_level;         // -z (바로 바뀜)
+    int workers;            // -w
+    int pin_cpus;           // -a
+    int coroutines;         // -c
+    int engine;             // -e (IO_SYNC / IO_URING)
+    int refresh_workers;    // -r
+    int drain_timeout;      // SIGINT/SIGTERM/drain 후 기다리는 초 (바로 바뀜)
+    int default_ttl;        // 신선도 정보가 없는 응답의 유효 시간 (초, 바로 바뀜)
+    int default_swr;        // stale_while_revalidate: 응답에 없을 때 쓰는 값 (초, 바로 바뀜)
+    int refresh_min_hits;   // 만료 전에 미리 갱신할 최소 조회 수 (바로 바뀜)
+    char sockopts[CONFIG_PATH_LEN];     // -o (backlog=N이 LISTENQ 대신)
+    char accesslog[CONFIG_PATH_LEN];    // -l
+    char admin_socket[CONFIG_PATH_LEN]; // -s
+    char cache_snapshot[CONFIG_PATH_LEN]; // 시작할 때 읽고 끝날 때 쓰는 캐시 스냅샷
+} ProxyConfig;
+
+void config_defaults(ProxyConfig *cfg);
+int config_set(ProxyConfig *cfg, const char *key, const char *value);
+int config_load(ProxyConfig *cfg, const char *path);
+
+#endif /* __CONFIG_H__ */
@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include "csapp.h"
+#include "coro.h"
+
+Sched scheds[CORO_MAX_SCHEDS];
+int nscheds;
+
+static __thread Sched *self; //이 스레드의 스케줄러 (스케줄러 스레드가 아니면 NULL)
+static void (*task_fn)(void *); //sched_submit으로 넣은 작업마다 코루틴으로 돌릴 함수
+
+typedef struct {
+    void (*init)(void *);
+    void *arg;
+    int id;
+} SchedStart;
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static unsigned deque_size(TaskDeque *d){
+    return __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE) - __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+}
+
+//주인만 부른다. 꽉 찼으면 -1
+static int deque_push(TaskDeque *d, void *task){
+    int ret = -1;
+
+    pthread_spin_lock(&d->lock);
+    if (d->bottom - d->top < SCHED_DEQUE) {
+        d->items[d->bottom % SCHED_DEQUE] = task;
+        __atomic_store_n(&d->bottom, d->bottom + 1, __ATOMIC_RELEASE);
+        ret = 0;
+    }
+    pthread_spin_unlock(&d->lock);
+    return ret;
+}
+
+//주인 쪽(bottom)에서 최대 max개를 꺼낸다
+static int deque_pop(TaskDeque *d, void **out, int max){
+    int n = 0;
+
+    pthread_spin_lock(&d->lock);
+    while (n < max && d->bottom != d->top) {
+        d->bottom--;
+        out[n++] = d->items[d->bottom % SCHED_DEQUE];
+    }
+    pthread_spin_unlock(&d->lock);
+    return n;
+}
+
+//도둑 쪽(top)에서 남은 것의 절반(최대 max개)을 가져간다
+static int deque_steal(TaskDeque *d, void **out, int max){
+    int n = 0, want;
+
+    if (deque_size(d) == 0) //빈 덱의 락은 건드리지 않는다
+        return 0;
+    pthread_spin_lock(&d->lock);
+    want = (d->bottom - d->top + 1) / 2;
+    if (want > max) want = max;
+    while (n < want) {
+        out[n++] = d->items[d->top % SCHED_DEQUE];
+        d->top++;
+    }
+    pthread_spin_unlock(&d->lock);
+    return n;
+}
+
+static void run_later(Sched *s, Coro *c){
+    c->next = NULL;
+    if (s->run_tail) s->run_tail->next = c;
+    else s->run_head = c;
+    s->run_tail = c;
+}
+
+//코루틴 본체를 돌리고, 끝나면 uc_link로 스케줄러 루프에 돌아간다
+static void trampoline(){
+    Coro *c = self->current;
+    c->fn(c->arg);
+    c->done = 1;
+}
+
+static Coro *new_coro(Sched *s){
+    Coro *c;
+    long page = sysconf(_SC_PAGESIZE);
+
+    if ((c = s->free_stacks) != NULL) {
+        s->free_stacks = c->next;
+        s->nfree--;
+        return c;
+    }
+    if ((c = calloc(1, sizeof(Coro))) == NULL)
+        return NULL;
+    // 실제로 건드린 페이지만 메모리를 쓴다. 맨 아래 한 페이지는 넘침 감지용
+    c->stack = mmap(NULL, CORO_STACK + page, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (c->stack == MAP_FAILED) {
+        free(c);
+        return NULL;
+    }
+    mprotect(c->stack, page, PROT_NONE);
+    return c;
+}
+
+static void free_coro(Sched *s, Coro *c){
+    if (s->nfree < CORO_FREE_STACKS) {
+        c->next = s->free_stacks;
+        s->free_stacks = c;
+        s->nfree++;
+        return;
+    }
+    munmap(c->stack, CORO_STACK + sysconf(_SC_PAGESIZE));
+    free(c);
+}
+
+/* 이 스레드의 스케줄러에 새 코루틴을 올린다. 다음 차례에 돌기 시작함 */
+int coro_spawn(void (*fn)(void *), void *arg){
+    Sched *s = self;
+    Coro *c;
+
+    if (s == NULL || (c = new_coro(s)) == NULL)
+        return -1;
+    c->fn = fn;
+    c->arg = arg;
+    c->done = 0;
+    getcontext(&c->ctx);
+    c->ctx.uc_stack.ss_sp = c->stack + sysconf(_SC_PAGESIZE);
+    c->ctx.uc_stack.ss_size = CORO_STACK;
+    c->ctx.uc_link = &s->main_ctx;
+    makecontext(&c->ctx, trampoline, 0);
+    s->live++;
+    s->spawned++;
+    run_later(s, c);
+    return 0;
+}
+
+//스케줄러로 돌아간다. 누군가 run_later로 다시 올려줄 때까지 멈춤
+static void park(Sched *s){
+    s->switches++;
+    swapcontext(&s->current->ctx, &s->main_ctx);
+}
+
+/*
+ * fd가 events(POLLIN/POLLOUT)로 준비될 때까지 이 코루틴만 멈춘다.
+ * rio가 EAGAIN을 받으면 부르는 훅. 코루틴 밖이면 -1 (호출한 쪽이 알아서 처리)
+ */
+int coro_wait(int fd, int events){
+    Sched *s = self;
+    struct epoll_event ev;
+
+    if (s == NULL || s->current == NULL)
+        return -1;
+    // ONESHOT: 한 번 깨우고 나면 다시 기다릴 때까지 꺼져 있음
+    ev.events = (events & POLLOUT ? EPOLLOUT : 0) | (events & POLLIN ? EPOLLIN : 0)
+                | EPOLLONESHOT | EPOLLRDHUP;
+    ev.data.ptr = s->current;
+    if (epoll_ctl(s->epfd, EPOLL_CTL_MOD, fd, &ev) < 0
+        && (errno != ENOENT || epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) < 0))
+        return -1;
+    park(s);
+    return 0;
+}
+
+/* 다른 코루틴에게 차례를 넘긴다 (긴 계산 중간에) */
+void coro_yield(){
+    Sched *s = self;
+
+    if (s == NULL || s->current == NULL)
+        return;
+    run_later(s, s->current);
+    park(s);
+}
+
+int coro_sched_id(){
+    return self ? self->id : -1;
+}
+
+/*
+ * 이 스레드 덱에 작업(보통 방금 accept한 연결)을 넣는다. 주인이 바쁜 사이
+ * 쌓이면 자고 있는 다른 스케줄러 하나를 깨워 훔쳐가게 한다.
+ * 스케줄러 밖이거나 덱이 꽉 찼으면 -1 (호출한 쪽이 직접 처리)
+ */
+int sched_submit(void *task){
+    Sched *s = self;
+    uint64_t one = 1;
+
+    if (s == NULL || deque_push(&s->deque, task) < 0)
+        return -1;
+    // 하나는 주인이 다음 바퀴에 바로 꺼낼 것이므로 둘째부터 남는 일
+    if (deque_size(&s->deque) < 2)
+        return 0;
+    for (int i = 1; i < nscheds; i++) {
+        Sched *t = &scheds[(s->id + i) % nscheds];
+        int idle = 1;
+        if (__atomic_compare_exchange_n(&t->idle, &idle, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+            if (write(t->wakefd, &one, sizeof(one)) < 0) {}
+            break;
+        }
+    }
+    return 0;
+}
+
+//자기 덱에서 꺼내고, 비어 있으면 다른 스케줄러 덱에서 훔쳐 코루틴으로 띄운다
+static int take_tasks(Sched *s){
+    void *tasks[SCHED_TASK_BATCH];
+    int n = deque_pop(&s->deque, tasks, SCHED_TASK_BATCH);
+
+    for (int i = 1; n == 0 && i < nscheds; i++) {
+        n = deque_steal(&scheds[(s->id + i) % nscheds].deque, tasks, SCHED_TASK_BATCH);
+        __atomic_add_fetch(&s->steals, n, __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < n; i++)
+        if (coro_spawn(task_fn, tasks[i]) < 0) {
+            // 스택을 못 만들면 남은 건 자기 덱에 되돌려 두고 코루틴이 끝나길 기다린다
+            // (방금 그만큼 꺼냈거나 빈 덱이라 자리는 있음)
+            for (int j = n - 1; j >= i; j--)
+                deque_push(&s->deque, tasks[j]);
+            return i;
+        }
+    return n;
+}
+
+/* 스케줄러마다 한 줄씩: 코루틴 수, 훔쳐온 작업 수, 이용률(epoll_wait로 자지 않은 시간 비율) */
+int sched_stats(char *buf, size_t len){
+    size_t off = 0;
+    uint64_t now = now_ns();
+
+    for (int i = 0; i < nscheds && off < len; i++) {
+        Sched *s = &scheds[i];
+        uint64_t start = __atomic_load_n(&s->start_ns, __ATOMIC_RELAXED);
+        uint64_t busy = __atomic_load_n(&s->busy_ns, __ATOMIC_RELAXED);
+        int n = snprintf(buf + off, len - off,
+                         "sched %d: live %lu  spawned %lu  steals %lu  queued %u  util %.1f%%\n",
+                         i, s->live, s->spawned, __atomic_load_n(&s->steals, __ATOMIC_RELAXED),
+                         deque_size(&s->deque), start && now > start ? 100.0 * busy / (now - start) : 0.0);
+        if (n < 0) break;
+        off += n;
+    }
+    return off < len ? (int)off : (int)len;
+}
+
+static void *sched_loop(void *vargp){
+    SchedStart *st = vargp;
+    Sched *s = &scheds[st->id];
+    struct epoll_event events[CORO_EVENTS];
+    uint64_t busy_from;
+
+    self = s;
+    rio_wait_hook = coro_wait; //이 스레드의 rio는 막히는 대신 코루틴을 멈춘다
+    coro_spawn(st->init, st->arg);
+    free(st);
+    busy_from = now_ns();
+    __atomic_store_n(&s->start_ns, busy_from, __ATOMIC_RELAXED);
+
+    while (1) {
+        // 이번 바퀴에 이미 줄 서 있던 것만 돌린다 (yield한 코루틴은 다음 바퀴로)
+        Coro *last = s->run_tail;
+        while (s->run_head) {
+            Coro *c = s->run_head;
+            if ((s->run_head = c->next) == NULL)
+                s->run_tail = NULL;
+            s->current = c;
+            swapcontext(&s->main_ctx, &c->ctx);
+            s->current = NULL;
+            if (c->done) {
+                s->live--;
+                free_coro(s, c);
+            }
+            if (c == last)
+                break;
+        }
+
+        // 바퀴마다 일한 시간을 더한다 (자지 않고 계속 도는 과부하 스케줄러도 잡히게)
+        uint64_t t = now_ns();
+        __atomic_add_fetch(&s->busy_ns, t - busy_from, __ATOMIC_RELAXED);
+        busy_from = t;
+
+        int timeout = 0;
+        if (take_tasks(s) == 0 && s->run_head == NULL) {
+            // 자기 전에 idle을 먼저 알리고 한 번 더 확인: 그 사이 들어온 작업을 놓치지 않게
+            __atomic_store_n(&s->idle, 1, __ATOMIC_SEQ_CST);
+            if (take_tasks(s) == 0)
+                timeout = -1;
+            else
+                __atomic_store_n(&s->idle, 0, __ATOMIC_SEQ_CST);
+        }
+        int n = epoll_wait(s->epfd, events, CORO_EVENTS, timeout);
+        if (timeout < 0) {
+            __atomic_store_n(&s->idle, 0, __ATOMIC_SEQ_CST);
+            busy_from = now_ns(); //자던 시간은 빼고
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) { //깨우기 (eventfd)
+                uint64_t cnt;
+                if (read(s->wakefd, &cnt, sizeof(cnt)) < 0) {}
+                continue;
+            }
+            run_later(s, events[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * 스케줄러 스레드를 nthreads개 띄운다. 스레드마다 init(arg)이 첫 코루틴으로 돈다
+ * (보통 거기서 accept 루프를 돌며 연결마다 sched_submit). 넣은 작업은 fn(task)로 돈다.
+ */
+int sched_start(int nthreads, void (*init)(void *arg), void *arg, void (*fn)(void *)){
+    struct epoll_event ev;
+
+    if (nthreads > CORO_MAX_SCHEDS)
+        nthreads = CORO_MAX_SCHEDS;
+    task_fn = fn;
+    // 스레드를 띄우기 전에 모두 만들어 둔다: 다른 스케줄러가 곧바로 덱과 wakefd를 건드림
+    for (int i = 0; i < nthreads; i++) {
+        Sched *s = &scheds[i];
+        s->id = i;
+        pthread_spin_init(&s->deque.lock, PTHREAD_PROCESS_PRIVATE);
+        if ((s->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0
+            || (s->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+            unix_error("sched_start error");
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(s->epfd, EPOLL_CTL_ADD, s->wakefd, &ev) < 0)
+            unix_error("epoll_ctl error");
+    }
+    nscheds = nthreads;
+    for (int i = 0; i < nthreads; i++) {
+        SchedStart *st = Malloc(sizeof(SchedStart));
+        st->init = init;
+        st->arg = arg;
+        st->id = i;
+        Pthread_create(&scheds[i].tid, NULL, sched_loop, st);
+    }
+    return nthreads;
+}
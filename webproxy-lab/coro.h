@@ -0,0 +1,71 @@
+#ifndef __CORO_H__
+#define __CORO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ucontext.h>
+#include <pthread.h>
+
+/* 코루틴 스택 크기. 오브젝트 버퍼는 힙이지만 handle_client의 MAXBUF 지역 버퍼들이 있어 넉넉히 */
+#define CORO_STACK (1 << 20)
+#define CORO_MAX_SCHEDS 64
+#define CORO_FREE_STACKS 64 //스케줄러마다 재사용하려고 남겨두는 스택 수
+#define CORO_EVENTS 256     //epoll_wait 한 번에 받는 이벤트 수
+#define SCHED_DEQUE 1024    //스케줄러마다 아직 시작 안 한 작업(새 연결)을 담는 덱 크기
+#define SCHED_TASK_BATCH 16 //한 바퀴에 덱에서 꺼내 시작하는 (또는 훔쳐오는) 최대 작업 수
+
+/*
+ * 스택이 있는 코루틴 하나. 소켓이 EAGAIN이면 epoll에 등록하고 스케줄러로
+ * 돌아가 있다가, 준비되면 멈춘 자리에서 다시 이어서 돈다.
+ */
+typedef struct _Coro{
+    ucontext_t ctx;
+    char *stack;            //가드 페이지 포함한 mmap 영역
+    void (*fn)(void *);
+    void *arg;
+    int done;
+    struct _Coro *next;     //실행 큐 / 스택 재사용 목록
+} Coro;
+
+/*
+ * 아직 코루틴을 만들지 않은 작업들. 주인은 bottom 쪽에서 넣고 꺼내고(LIFO, 캐시에
+ * 따뜻한 것부터), 일이 없는 다른 스케줄러는 top 쪽에서 훔쳐간다(FIFO).
+ * 락은 덱마다 따로라서 평소에는 주인 혼자만 잡는다.
+ */
+typedef struct _TaskDeque{
+    pthread_spinlock_t lock;
+    unsigned top, bottom;
+    void *items[SCHED_DEQUE];
+} TaskDeque;
+
+/*
+ * OS 스레드 하나에 붙은 스케줄러. 시작한 코루틴은 이 스레드에서만 돈다
+ * (fd가 이 스레드의 epoll에 걸려 있으므로). 옮겨 다니는 건 시작 전 작업뿐.
+ */
+typedef struct _Sched{
+    int id;
+    int epfd;
+    pthread_t tid;
+    ucontext_t main_ctx;    //스케줄러 루프
+    Coro *current;
+    Coro *run_head, *run_tail; //다시 돌릴 차례인 코루틴
+    Coro *free_stacks;
+    int nfree;
+    unsigned long live;     //살아있는 코루틴 수
+    unsigned long spawned, switches;
+    TaskDeque deque;
+    int wakefd;             //일 없이 epoll_wait에서 자는 스케줄러를 깨우는 eventfd
+    int idle;               //epoll_wait(-1)로 자는 중 (atomic)
+    unsigned long steals;   //다른 스케줄러의 덱에서 훔쳐온 작업 수
+    uint64_t busy_ns, start_ns; //이용률 = busy_ns / (지금 - start_ns)
+} Sched;
+
+int sched_start(int nthreads, void (*init)(void *arg), void *arg, void (*task_fn)(void *));
+int sched_submit(void *task);
+int sched_stats(char *buf, size_t len);
+int coro_spawn(void (*fn)(void *), void *arg);
+int coro_wait(int fd, int events);
+void coro_yield();
+int coro_sched_id();
+
+#endif /* __CORO_H__ */
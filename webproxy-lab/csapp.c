@@ -22,6 +22,7 @@
  *   - rio_readnb: removed redundant EINTR check
  */
 /* $begin csapp.c */
+#define _GNU_SOURCE /* accept4, pthread_setaffinity_np */
 #include "csapp.h"
 
 /************************** 
@@ -587,6 +588,15 @@ int Accept(int s, struct sockaddr *addr, socklen_t *addrlen)
     return rc;
 }
 
+int Accept4(int s, struct sockaddr *addr, socklen_t *addrlen, int flags) 
+{
+    int rc;
+
+    if ((rc = accept4(s, addr, addrlen, flags)) < 0)
+	unix_error("Accept4 error");
+    return rc;
+}
+
 void Connect(int sockfd, struct sockaddr *serv_addr, int addrlen) 
 {
     int rc;
@@ -716,6 +726,25 @@ void Pthread_once(pthread_once_t *once_control, void (*init_function)()) {
     pthread_once(once_control, init_function);
 }
 
+/*
+ * pin_thread_to_cpu - Pin the calling thread to one CPU (modulo the
+ *     number of online CPUs). Threads it creates inherit the mask.
+ *     Returns 0 on success, -1 (with a warning) otherwise.
+ */
+int pin_thread_to_cpu(int cpu) {
+    cpu_set_t set;
+    int rc;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu % (ncpu > 0 ? ncpu : 1), &set);
+    if ((rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) != 0) {
+        fprintf(stderr, "pin_thread_to_cpu: %s\n", strerror(rc));
+        return -1;
+    }
+    return 0;
+}
+
 /*******************************
  * Wrappers for Posix semaphores
  *******************************/
@@ -742,6 +771,106 @@ void V(sem_t *sem)
  * The Rio package - Robust I/O functions
  ****************************************/
 
+/* read()/write() calls made by rio, for stats. Each thread counts into its
+   own slot so the hot path never bounces a shared cache line between cores;
+   rio_syscall_count sums the live slots plus what exited threads left. */
+typedef struct rio_counter {
+    unsigned long n;
+    struct rio_counter *prev, *next;
+} rio_counter_t;
+
+static pthread_mutex_t rio_counters_lock = PTHREAD_MUTEX_INITIALIZER;
+static rio_counter_t *rio_counters;         /* live threads */
+static unsigned long rio_counters_exited;   /* sum from threads that exited */
+static pthread_key_t rio_counter_key;
+static pthread_once_t rio_counter_once = PTHREAD_ONCE_INIT;
+static __thread rio_counter_t rio_counter_self;
+static __thread int rio_counter_registered;
+
+/* Thread exit: fold this thread's count into the total and unlink it */
+static void rio_counter_exit(void *arg)
+{
+    rio_counter_t *c = arg;
+
+    pthread_mutex_lock(&rio_counters_lock);
+    rio_counters_exited += c->n;
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        rio_counters = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    pthread_mutex_unlock(&rio_counters_lock);
+}
+
+static void rio_counter_init(void)
+{
+    pthread_key_create(&rio_counter_key, rio_counter_exit);
+}
+
+static void rio_counter_register(void)
+{
+    rio_counter_t *c = &rio_counter_self;
+
+    pthread_once(&rio_counter_once, rio_counter_init);
+    pthread_mutex_lock(&rio_counters_lock);
+    c->prev = NULL;
+    c->next = rio_counters;
+    if (rio_counters)
+        rio_counters->prev = c;
+    rio_counters = c;
+    pthread_mutex_unlock(&rio_counters_lock);
+    pthread_setspecific(rio_counter_key, c);
+    rio_counter_registered = 1;
+}
+
+/* Only this thread writes its slot; the relaxed store just keeps readers tear-free */
+#define RIO_SYSCALL() do {                                                   \
+    if (!rio_counter_registered)                                              \
+        rio_counter_register();                                               \
+    __atomic_store_n(&rio_counter_self.n, rio_counter_self.n + 1, __ATOMIC_RELAXED); \
+} while (0)
+
+void rio_count_syscall(void)
+{
+    RIO_SYSCALL();
+}
+
+unsigned long rio_syscall_count(void)
+{
+    unsigned long sum;
+
+    pthread_mutex_lock(&rio_counters_lock);
+    sum = rio_counters_exited;
+    for (rio_counter_t *c = rio_counters; c; c = c->next)
+        sum += __atomic_load_n(&c->n, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&rio_counters_lock);
+    return sum;
+}
+
+__thread int (*rio_wait_hook)(int fd, int events) = NULL;
+
+/* EAGAIN on a non-blocking fd: let the coroutine scheduler park us until
+   fd is ready. Returns 1 if the operation should be retried */
+static int rio_would_block(int fd, int events)
+{
+    return (errno == EAGAIN || errno == EWOULDBLOCK)
+        && rio_wait_hook && rio_wait_hook(fd, events) == 0;
+}
+
+/*
+ * rio_wait - Wait until fd is ready for events (POLLIN/POLLOUT). Inside
+ *    a coroutine only the coroutine waits; otherwise this is poll().
+ */
+int rio_wait(int fd, int events)
+{
+    struct pollfd pfd = { fd, events, 0 };
+
+    if (rio_wait_hook && rio_wait_hook(fd, events) == 0)
+        return 0;
+    return poll(&pfd, 1, -1) < 0 ? -1 : 0;
+}
+
 /*
  * rio_readn - Robustly read n bytes (unbuffered)
  */
@@ -753,9 +882,12 @@ ssize_t rio_readn(int fd, void *usrbuf, size_t n)
     char *bufp = usrbuf;
 
     while (nleft > 0) {
+	RIO_SYSCALL();
 	if ((nread = read(fd, bufp, nleft)) < 0) {
 	    if (errno == EINTR) /* Interrupted by sig handler return */
 		nread = 0;      /* and call read() again */
+	    else if (rio_would_block(fd, POLLIN))
+		nread = 0;
 	    else
 		return -1;      /* errno set by read() */ 
 	} 
@@ -779,9 +911,12 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
     char *bufp = usrbuf;
 
     while (nleft > 0) {
+	RIO_SYSCALL();
 	if ((nwritten = write(fd, bufp, nleft)) <= 0) {
 	    if (errno == EINTR)  /* Interrupted by sig handler return */
 		nwritten = 0;    /* and call write() again */
+	    else if (nwritten < 0 && rio_would_block(fd, POLLOUT))
+		nwritten = 0;
 	    else
 		return -1;       /* errno set by write() */
 	}
@@ -792,6 +927,45 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
 }
 /* $end rio_writen */
 
+/*
+ * rio_writev - Robustly write all iovcnt segments in one writev() call
+ *    when possible. iov is consumed (advanced past what was written).
+ */
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    size_t total = 0;
+    ssize_t nwritten;
+
+    while (iovcnt > 0) {
+	if (iov->iov_len == 0) {   /* skip empty and fully written segments */
+	    iov++;
+	    iovcnt--;
+	    continue;
+	}
+	RIO_SYSCALL();
+	if ((nwritten = writev(fd, iov, iovcnt)) <= 0) {
+	    if (errno == EINTR)
+		nwritten = 0;
+	    else if (nwritten < 0 && rio_would_block(fd, POLLOUT))
+		nwritten = 0;
+	    else
+		return -1;       /* errno set by writev() */
+	}
+	total += nwritten;
+	while (nwritten > 0) {     /* short write: advance into the segments */
+	    size_t step = (size_t)nwritten < iov->iov_len ? (size_t)nwritten : iov->iov_len;
+	    iov->iov_base = (char *)iov->iov_base + step;
+	    iov->iov_len -= step;
+	    nwritten -= step;
+	    if (iov->iov_len == 0) {
+		iov++;
+		iovcnt--;
+	    }
+	}
+    }
+    return total;
+}
+
 
 /* 
  * rio_read - This is a wrapper for the Unix read() function that
@@ -807,10 +981,11 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
     int cnt;
 
     while (rp->rio_cnt <= 0) {  /* Refill if buf is empty */
+	RIO_SYSCALL();
 	rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, 
 			   sizeof(rp->rio_buf));
 	if (rp->rio_cnt < 0) {
-	    if (errno != EINTR) /* Interrupted by sig handler return */
+	    if (errno != EINTR && !rio_would_block(rp->rio_fd, POLLIN))
 		return -1;
 	}
 	else if (rp->rio_cnt == 0)  /* EOF */
@@ -911,6 +1086,12 @@ void Rio_writen(int fd, void *usrbuf, size_t n)
 	unix_error("Rio_writen error");
 }
 
+void Rio_writev(int fd, struct iovec *iov, int iovcnt)
+{
+    if (rio_writev(fd, iov, iovcnt) < 0)
+	unix_error("Rio_writev error");
+}
+
 void Rio_readinitb(rio_t *rp, int fd)
 {
     rio_readinitb(rp, fd);
@@ -934,6 +1115,111 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
     return rc;
 } 
 
+/******************************** 
+ * Socket tuning
+ ********************************/
+sockopts_t sockopts = { LISTENQ, 0, 0, 0, 0, 0 };
+
+/*
+ * parse_sockopts - Parse a comma separated list like
+ *     "nodelay,defer=1,fastopen=256,sndbuf=262144,rcvbuf=262144,backlog=4096"
+ *     into sockopts. Returns 0 on success, -1 on an unknown option.
+ */
+int parse_sockopts(char *spec)
+{
+    char *save, *tok, *val;
+    char copy[MAXLINE];
+
+    strncpy(copy, spec, MAXLINE - 1);
+    copy[MAXLINE - 1] = '\0';
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        int n = 1;
+        if ((val = strchr(tok, '=')) != NULL) {
+            *val++ = '\0';
+            n = atoi(val);
+        }
+        if (!strcmp(tok, "nodelay"))
+            sockopts.nodelay = n;
+        else if (!strcmp(tok, "defer"))
+            sockopts.defer_accept = n;
+        else if (!strcmp(tok, "fastopen"))
+            sockopts.fastopen = n;
+        else if (!strcmp(tok, "sndbuf"))
+            sockopts.sndbuf = n;
+        else if (!strcmp(tok, "rcvbuf"))
+            sockopts.rcvbuf = n;
+        else if (!strcmp(tok, "backlog"))
+            sockopts.backlog = n > 0 ? n : LISTENQ;
+        else {
+            fprintf(stderr, "parse_sockopts: unknown option %s\n", tok);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Failures here only cost performance, so they are reported and ignored */
+static void try_setsockopt(int fd, int level, int optname, int val, char *name)
+{
+    if (setsockopt(fd, level, optname, &val, sizeof(val)) < 0)
+        fprintf(stderr, "setsockopt %s: %s\n", name, strerror(errno));
+}
+
+void apply_listen_sockopts(int fd)
+{
+    if (sockopts.defer_accept)
+        try_setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, sockopts.defer_accept, "TCP_DEFER_ACCEPT");
+    if (sockopts.fastopen)
+        try_setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, sockopts.fastopen, "TCP_FASTOPEN");
+    /* Accepted sockets inherit the buffer sizes of the listener */
+    if (sockopts.sndbuf)
+        try_setsockopt(fd, SOL_SOCKET, SO_SNDBUF, sockopts.sndbuf, "SO_SNDBUF");
+    if (sockopts.rcvbuf)
+        try_setsockopt(fd, SOL_SOCKET, SO_RCVBUF, sockopts.rcvbuf, "SO_RCVBUF");
+}
+
+void apply_conn_sockopts(int fd)
+{
+    if (sockopts.nodelay)
+        try_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    if (sockopts.sndbuf)
+        try_setsockopt(fd, SOL_SOCKET, SO_SNDBUF, sockopts.sndbuf, "SO_SNDBUF");
+    if (sockopts.rcvbuf)
+        try_setsockopt(fd, SOL_SOCKET, SO_RCVBUF, sockopts.rcvbuf, "SO_RCVBUF");
+}
+
+/* Accepted sockets already inherit the listener's buffer sizes */
+void apply_accepted_sockopts(int fd)
+{
+    if (sockopts.nodelay)
+        try_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+}
+
+/*
+ * accept_batch - Accept up to max pending connections from a
+ *     non-blocking listening socket, stopping at EAGAIN, so one wakeup
+ *     drains the whole accept queue. Returns the number of descriptors
+ *     stored in fds (0 if none were pending), or -1 on a real error.
+ */
+int accept_batch(int listenfd, int *fds, int max)
+{
+    int n = 0, fd;
+
+    while (n < max) {
+        if ((fd = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC)) < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return n > 0 ? n : -1;
+        }
+        /* accept4 without SOCK_NONBLOCK: handlers use blocking Rio I/O */
+        apply_accepted_sockopts(fd);
+        fds[n++] = fd;
+    }
+    return n;
+}
+
 /******************************** 
  * Client/server helper functions
  ********************************/
@@ -967,9 +1253,24 @@ int open_clientfd(char *hostname, char *port) {
         if ((clientfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0) 
             continue; /* Socket failed, try the next */
 
+        /* Buffer sizes must be set before connect to affect window scaling */
+        apply_conn_sockopts(clientfd);
+
+        /* Inside a coroutine, connect without blocking the thread */
+        if (rio_wait_hook)
+            fcntl(clientfd, F_SETFL, fcntl(clientfd, F_GETFL) | O_NONBLOCK);
+
         /* Connect to the server */
         if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1) 
             break; /* Success */
+        if (errno == EINPROGRESS && rio_wait_hook
+            && rio_wait_hook(clientfd, POLLOUT) == 0) {
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(clientfd, SOL_SOCKET, SO_ERROR, &err, &len);
+            if (err == 0)
+                break;
+        }
         if (close(clientfd) < 0) { /* Connect failed, try another */  //line:netp:openclientfd:closefd
             fprintf(stderr, "open_clientfd: close failed: %s\n", strerror(errno));
             return -1;
@@ -992,9 +1293,12 @@ int open_clientfd(char *hostname, char *port) {
  *     On error, returns: 
  *       -2 for getaddrinfo error
  *       -1 with errno set for other errors.
+ *
+ *     open_reuseport_listenfd additionally sets SO_REUSEPORT, so several
+ *     threads can each own a listening socket on the same port and the
+ *     kernel spreads incoming connections across them.
  */
-/* $begin open_listenfd */
-int open_listenfd(char *port) 
+static int open_listenfd_common(char *port, int reuseport) 
 {
     struct addrinfo hints, *listp, *p;
     int listenfd, rc, optval=1;
@@ -1018,6 +1322,11 @@ int open_listenfd(char *port)
         /* Eliminates "Address already in use" error from bind */
         setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,    //line:netp:csapp:setsockopt
                    (const void *)&optval , sizeof(int));
+        if (reuseport && setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT,
+                                    (const void *)&optval, sizeof(int)) < 0) {
+            close(listenfd);
+            continue;
+        }
 
         /* Bind the descriptor to the address */
         if (bind(listenfd, p->ai_addr, p->ai_addrlen) == 0)
@@ -1034,13 +1343,27 @@ int open_listenfd(char *port)
     if (!p) /* No address worked */
         return -1;
 
+    /* TCP_FASTOPEN has to be set before listen() */
+    apply_listen_sockopts(listenfd);
+
     /* Make it a listening socket ready to accept connection requests */
-    if (listen(listenfd, LISTENQ) < 0) {
+    if (listen(listenfd, sockopts.backlog) < 0) {
         close(listenfd);
 	return -1;
     }
     return listenfd;
 }
+
+/* $begin open_listenfd */
+int open_listenfd(char *port) 
+{
+    return open_listenfd_common(port, 0);
+}
+
+int open_reuseport_listenfd(char *port) 
+{
+    return open_listenfd_common(port, 1);
+}
 /* $end open_listenfd */
 
 /****************************************************
@@ -1064,6 +1387,15 @@ int Open_listenfd(char *port)
     return rc;
 }
 
+int Open_reuseport_listenfd(char *port) 
+{
+    int rc;
+
+    if ((rc = open_reuseport_listenfd(port)) < 0)
+	unix_error("Open_reuseport_listenfd error");
+    return rc;
+}
+
 /* $end csapp.c */
 
 
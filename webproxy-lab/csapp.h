@@ -28,6 +28,9 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 /* Default file permissions are DEF_MODE & ~DEF_UMASK */
 /* $begin createmasks */
@@ -61,6 +64,8 @@ extern char **environ; /* Defined by libc */
 #define LISTENQ  1024  /* Second argument to listen() */
 
 /* Our own error-handling functions */
+/* _GNU_SOURCE를 켜면 glibc의 gai_error(struct gaicb *)와 이름이 겹치므로 바꿔둔다 */
+#define gai_error csapp_gai_error
 void unix_error(char *msg);
 void posix_error(int code, char *msg);
 void dns_error(char *msg);
@@ -142,6 +147,7 @@ void Setsockopt(int s, int level, int optname, const void *optval, int optlen);
 void Bind(int sockfd, struct sockaddr *my_addr, int addrlen);
 void Listen(int s, int backlog);
 int Accept(int s, struct sockaddr *addr, socklen_t *addrlen);
+int Accept4(int s, struct sockaddr *addr, socklen_t *addrlen, int flags);
 void Connect(int sockfd, struct sockaddr *serv_addr, int addrlen);
 
 /* Protocol independent wrappers */
@@ -166,6 +172,7 @@ void Pthread_detach(pthread_t tid);
 void Pthread_exit(void *retval);
 pthread_t Pthread_self(void);
 void Pthread_once(pthread_once_t *once_control, void (*init_function)());
+int pin_thread_to_cpu(int cpu);
 
 /* POSIX semaphore wrappers */
 void Sem_init(sem_t *sem, int pshared, unsigned int value);
@@ -173,8 +180,15 @@ void P(sem_t *sem);
 void V(sem_t *sem);
 
 /* Rio (Robust I/O) package */
+void rio_count_syscall(void);        /* count a read()/write() made for rio-style I/O (stats) */
+unsigned long rio_syscall_count(void); /* total so far, summed over all threads */
+/* Set per thread by a coroutine scheduler: called when a non-blocking fd
+   would block; returns 0 once fd is ready, -1 if the caller can't yield */
+extern __thread int (*rio_wait_hook)(int fd, int events);
+int rio_wait(int fd, int events);
 ssize_t rio_readn(int fd, void *usrbuf, size_t n);
 ssize_t rio_writen(int fd, void *usrbuf, size_t n);
+ssize_t rio_writev(int fd, struct iovec *iov, int iovcnt);
 void rio_readinitb(rio_t *rp, int fd); 
 ssize_t	rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t	rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
@@ -182,17 +196,38 @@ ssize_t	rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
 /* Wrappers for Rio package */
 ssize_t Rio_readn(int fd, void *usrbuf, size_t n);
 void Rio_writen(int fd, void *usrbuf, size_t n);
+void Rio_writev(int fd, struct iovec *iov, int iovcnt);
 void Rio_readinitb(rio_t *rp, int fd); 
 ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
 
+/* Socket tuning applied by open_listenfd/open_clientfd and to accepted
+   sockets via apply_accepted_sockopts(). Zero means "leave kernel default". */
+typedef struct {
+    int backlog;       /* listen() backlog (LISTENQ by default) */
+    int nodelay;       /* TCP_NODELAY on accepted and upstream sockets */
+    int defer_accept;  /* TCP_DEFER_ACCEPT seconds on listening sockets */
+    int fastopen;      /* TCP_FASTOPEN queue length on listening sockets */
+    int sndbuf;        /* SO_SNDBUF bytes on accepted and upstream sockets */
+    int rcvbuf;        /* SO_RCVBUF bytes on accepted and upstream sockets */
+} sockopts_t;
+extern sockopts_t sockopts;
+
+int parse_sockopts(char *spec);
+void apply_listen_sockopts(int fd);
+void apply_conn_sockopts(int fd);
+void apply_accepted_sockopts(int fd);
+int accept_batch(int listenfd, int *fds, int max);
+
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(char *hostname, char *port);
 int open_listenfd(char *port);
+int open_reuseport_listenfd(char *port);
 
 /* Wrappers for reentrant protocol-independent client/server helpers */
 int Open_clientfd(char *hostname, char *port);
 int Open_listenfd(char *port);
+int Open_reuseport_listenfd(char *port);
 
 
 #endif /* __CSAPP_H__ */
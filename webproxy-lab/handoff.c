@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/un.h>
+#include "csapp.h"
+#include "handoff.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int listeners[HANDOFF_MAX_FDS];
+static int nlisteners;
+static int closed;       //drain을 시작함: 리스너들이 곧 닫히므로 더는 넘겨주지 않음
+static int old_fd = -1;  //새 프로세스 쪽: 옛 프로세스 관리 채널 (drain을 보낼 때까지 열어 둠)
+
+/* 넘겨줄 수 있게 듣기 소켓을 기록한다. 가득 찼으면 -1 (그 소켓은 넘겨주지 않음) */
+int handoff_add_listener(int fd){
+    int ret = -1;
+
+    pthread_mutex_lock(&lock);
+    if (!closed && nlisteners < HANDOFF_MAX_FDS) {
+        listeners[nlisteners++] = fd;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&lock);
+    return ret;
+}
+
+/* drain 시작. 이후 listeners 요청은 거절 */
+void handoff_close(void){
+    pthread_mutex_lock(&lock);
+    closed = 1;
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * 관리 채널(fd)로 "listeners <n>\n"과 함께 듣기 소켓 n개를 보낸다 (관리 스레드에서 부름).
+ * drain 중이거나 보낼 소켓이 없으면 -1
+ */
+int handoff_send_listeners(int fd){
+    char text[32], cbuf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    int n, ret;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(cbuf, 0, sizeof(cbuf));
+    pthread_mutex_lock(&lock);
+    if (closed || nlisteners == 0) {
+        pthread_mutex_unlock(&lock);
+        return -1;
+    }
+    n = nlisteners;
+    iov.iov_base = text;
+    iov.iov_len = snprintf(text, sizeof(text), "listeners %d\n", n);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+    cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * n);
+    memcpy(CMSG_DATA(cm), listeners, sizeof(int) * n);
+    // 락을 쥔 채로 보낸다: 보내는 동안 drain이 시작돼 리스너가 닫히지 않게
+    while ((ret = sendmsg(fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+        ;
+    pthread_mutex_unlock(&lock);
+    return ret < 0 ? -1 : n;
+}
+
+/*
+ * 새 프로세스 쪽: path(옛 프로세스의 관리 소켓)에 붙어 듣기 소켓들을 받아 fds에 넣는다.
+ * 연결은 handoff_release까지 열어 둔다. 받은 수, 실패하면 -1
+ */
+int handoff_fetch(const char *path, int *fds, int max){
+    struct sockaddr_un addr;
+    char text[MAXLINE], cbuf[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_FDS)];
+    struct iovec iov = { text, sizeof(text) - 1 };
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    ssize_t r;
+    int n = 0, want;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((old_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return -1;
+    if (connect(old_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || send(old_fd, "listeners\n", 10, MSG_NOSIGNAL) != 10)
+        goto fail;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    while ((r = recvmsg(old_fd, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+        ;
+    if (r <= 0)
+        goto fail;
+    text[r] = '\0';
+    for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+            continue;
+        int got = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < got; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+            if (n < max)
+                fds[n++] = fd;
+            else
+                close(fd);
+        }
+    }
+    if (sscanf(text, "listeners %d", &want) != 1 || n == 0) {
+        fprintf(stderr, "handoff: %s: %s", path, text[0] ? text : "no listeners\n");
+        for (int i = 0; i < n; i++)
+            close(fds[i]);
+        goto fail;
+    }
+    return n;
+
+fail:
+    close(old_fd);
+    old_fd = -1;
+    return -1;
+}
+
+/* 옛 프로세스에게 캐시를 path에 스냅샷으로 쓰게 한다 (handoff_fetch 뒤, 캐시를 읽기 전). 쓴 엔트리 수 */
+int handoff_snapshot(const char *path){
+    char buf[MAXLINE];
+    int len, n = 0, saved;
+
+    if (old_fd < 0)
+        return -1;
+    len = snprintf(buf, sizeof(buf), "snapshot %s\n", path);
+    if (len >= (int)sizeof(buf) || send(old_fd, buf, len, MSG_NOSIGNAL) != len)
+        return -1;
+    //답은 한 줄: "saved <n>" 또는 "error: ..."
+    while (n < (int)sizeof(buf) - 1 && read(old_fd, buf + n, 1) == 1 && buf[n] != '\n')
+        n++;
+    buf[n] = '\0';
+    if (sscanf(buf, "saved %d", &saved) != 1) {
+        fprintf(stderr, "handoff: snapshot: %s\n", buf);
+        return -1;
+    }
+    return saved;
+}
+
+/* 새 프로세스가 받은 소켓으로 accept를 시작한 뒤 부른다: 옛 프로세스에 drain을 보냄 */
+int handoff_release(void){
+    char buf[MAXLINE];
+    ssize_t r;
+
+    if (old_fd < 0)
+        return -1;
+    if (send(old_fd, "drain\n", 6, MSG_NOSIGNAL) != 6) { //옛 프로세스가 이미 나갔으면 SIGPIPE 대신 실패
+        close(old_fd);
+        old_fd = -1;
+        return -1;
+    }
+    shutdown(old_fd, SHUT_WR);
+    r = read(old_fd, buf, sizeof(buf) - 1); //"draining" (옛 프로세스가 받았다는 확인)
+    close(old_fd);
+    old_fd = -1;
+    return r > 0 ? 0 : -1;
+}
@@ -0,0 +1,22 @@
+#ifndef __HANDOFF_H__
+#define __HANDOFF_H__
+
+/*
+ * 무중단 바이너리 교체. 새 프로세스를 -x <옛 프로세스의 관리 소켓>으로 띄우면
+ *   1. 관리 채널에 listeners를 보내 옛 프로세스의 듣기 소켓들을 SCM_RIGHTS로 받고
+ *   2. 새로 bind하지 않고 그 소켓들로 accept를 시작한 뒤
+ *   3. drain을 보내 옛 프로세스가 accept를 멈추고 처리 중인 요청만 끝내고 나가게 한다.
+ * cache_snapshot이 설정돼 있으면 그 사이에 옛 프로세스에게 캐시 스냅샷을 쓰게 해서
+ * 새 프로세스가 그걸 읽고 시작한다 (바꾼 직후에도 캐시가 비어 있지 않음).
+ * 듣기 소켓은 한 번도 닫히지 않으므로 그 사이 accept 큐에 쌓인 연결도 잃지 않는다.
+ */
+#define HANDOFF_MAX_FDS 64 //넘겨줄 수 있는 듣기 소켓 수 (CORO_MAX_SCHEDS와 같게)
+
+int handoff_add_listener(int fd);
+void handoff_close(void);
+int handoff_send_listeners(int fd);
+int handoff_fetch(const char *path, int *fds, int max);
+int handoff_snapshot(const char *path);
+int handoff_release(void);
+
+#endif /* __HANDOFF_H__ */
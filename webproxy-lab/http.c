@@ -0,0 +1,380 @@
+#define _GNU_SOURCE /* strptime, timegm, memmem */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "http.h"
+
+#define HTTP_LINE 8192
+
+int http_default_ttl = HTTP_DEFAULT_TTL;
+int http_default_swr = 0;
+
+/* "Sun, 06 Nov 1994 08:49:37 GMT" (RFC 1123) -> time_t. 실패하면 0 */
+time_t parse_http_date(const char *s){
+    struct tm tm;
+    const char *end;
+
+    while (*s == ' ' || *s == '\t') s++;
+    memset(&tm, 0, sizeof(tm));
+    end = strptime(s, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL)
+        return 0;
+    return timegm(&tm);
+}
+
+/* time_t -> "Sun, 06 Nov 1994 08:49:37 GMT" */
+void format_http_date(time_t t, char *buf, size_t len){
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, len, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+//헤더 값 앞의 공백을 건너뛴 위치
+static const char *header_value(const char *line, size_t namelen){
+    const char *v = line + namelen;
+    while (*v == ' ' || *v == '\t') v++;
+    return v;
+}
+
+//"max-age=60, private" 같은 Cache-Control 값을 디렉티브 단위로 본다
+static void parse_cache_control(const char *value, HttpResponse *resp){
+    char copy[HTTP_LINE], *save, *tok;
+
+    strncpy(copy, value, HTTP_LINE - 1);
+    copy[HTTP_LINE - 1] = '\0';
+    for (tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        while (isspace((unsigned char)*tok)) tok++;
+        if (!strncasecmp(tok, "no-store", 8))
+            resp->no_store = 1;
+        else if (!strncasecmp(tok, "no-cache", 8))
+            resp->no_cache = 1;
+        else if (!strncasecmp(tok, "private", 7))
+            resp->is_private = 1;
+        else if (!strncasecmp(tok, "s-maxage=", 9))
+            resp->s_maxage = atol(tok + 9);
+        else if (!strncasecmp(tok, "max-age=", 8))
+            resp->max_age = atol(tok + 8);
+        else if (!strncasecmp(tok, "no-transform", 12))
+            resp->no_transform = 1;
+        else if (!strncasecmp(tok, "stale-while-revalidate=", 23))
+            resp->swr = atol(tok + 23);
+    }
+}
+
+//"Accept-Encoding, User-Agent" -> "accept-encoding,user-agent," (Vary가 여러 줄이면 이어 붙임)
+static void parse_vary(const char *value, HttpResponse *resp){
+    char copy[HTTP_LINE], *save, *tok;
+    size_t n = strlen(resp->vary);
+
+    strncpy(copy, value, HTTP_LINE - 1);
+    copy[HTTP_LINE - 1] = '\0';
+    for (tok = strtok_r(copy, ", \t", &save); tok; tok = strtok_r(NULL, ", \t", &save)) {
+        size_t len = strlen(tok);
+        // "*"이거나 다 못 담으면 변형을 구분할 수 없으니 캐시하지 않도록 "*"로 둔다
+        if (!strcmp(tok, "*") || !strcmp(resp->vary, "*") || n + len + 2 > HTTP_VARY_LEN) {
+            strcpy(resp->vary, "*");
+            return;
+        }
+        for (size_t i = 0; i < len; i++)
+            resp->vary[n++] = tolower((unsigned char)tok[i]);
+        resp->vary[n++] = ',';
+        resp->vary[n] = '\0';
+    }
+}
+
+/*
+ * buf의 앞부분에서 상태 줄과 헤더를 파싱한다. 빈 줄까지 다 들어와
+ * 있으면 1, 아직 헤더가 덜 왔으면 0, 응답 형식이 아니면 -1.
+ */
+int parse_response_headers(const char *buf, size_t len, HttpResponse *resp){
+    const char *end, *line, *next;
+    char tmp[HTTP_LINE];
+
+    memset(resp, 0, sizeof(*resp));
+    resp->max_age = resp->s_maxage = -1;
+    resp->range_total = -1;
+
+    if ((end = memmem(buf, len, "\r\n\r\n", 4)) == NULL)
+        return len >= 5 && strncmp(buf, "HTTP/", 5) ? -1 : 0;
+    resp->header_len = end + 4 - buf;
+    if (sscanf(buf, "HTTP/%*s %d", &resp->status) != 1)
+        return -1;
+
+    line = (const char *)memmem(buf, len, "\r\n", 2) + 2; // 상태 줄 다음부터
+    for (; line < end; line = next + 2) {
+        size_t n;
+        next = memmem(line, end + 2 - line, "\r\n", 2);
+        n = next - line;
+        if (n >= HTTP_LINE) continue;
+        memcpy(tmp, line, n);
+        tmp[n] = '\0';
+
+        if (!strncasecmp(tmp, "Cache-Control:", 14))
+            parse_cache_control(header_value(tmp, 14), resp);
+        else if (!strncasecmp(tmp, "Pragma:", 7) && strstr(tmp, "no-cache"))
+            resp->no_cache = 1;
+        else if (!strncasecmp(tmp, "Expires:", 8))
+            resp->expires = parse_http_date(header_value(tmp, 8)) ?: 1; //잘못된 값은 이미 만료로 취급
+        else if (!strncasecmp(tmp, "Date:", 5))
+            resp->date = parse_http_date(header_value(tmp, 5));
+        else if (!strncasecmp(tmp, "Last-Modified:", 14))
+            resp->last_modified = parse_http_date(header_value(tmp, 14));
+        else if (!strncasecmp(tmp, "Age:", 4))
+            resp->age = atol(header_value(tmp, 4));
+        else if (!strncasecmp(tmp, "Set-Cookie:", 11))
+            resp->set_cookie = 1;
+        else if (!strncasecmp(tmp, "Content-Range:", 14)) {
+            const char *slash = strchr(tmp, '/');
+            if (slash && isdigit((unsigned char)slash[1]))
+                resp->range_total = atol(slash + 1);
+        }
+        else if (!strncasecmp(tmp, "Content-Type:", 13)) {
+            strncpy(resp->content_type, header_value(tmp, 13), HTTP_TYPE_LEN - 1);
+            resp->content_type[HTTP_TYPE_LEN - 1] = '\0';
+        }
+        else if (!strncasecmp(tmp, "Content-Encoding:", 17))
+            resp->encoded = strncasecmp(header_value(tmp, 17), "identity", 8) != 0;
+        else if (!strncasecmp(tmp, "Vary:", 5))
+            parse_vary(header_value(tmp, 5), resp);
+        else if (!strncasecmp(tmp, "ETag:", 5)) {
+            strncpy(resp->etag, header_value(tmp, 5), HTTP_ETAG_LEN - 1);
+            resp->etag[HTTP_ETAG_LEN - 1] = '\0';
+        }
+    }
+    return 1;
+}
+
+/* 공유 캐시에 저장해도 되는 응답인지 */
+int response_cacheable(const HttpResponse *resp){
+    switch (resp->status) {
+    case 200: case 203: case 300: case 301: case 410:
+        break;
+    default:
+        return 0; // 404, 500 같은 응답은 저장하지 않음
+    }
+    if (resp->no_store || resp->is_private || resp->set_cookie)
+        return 0;
+    if (!strcmp(resp->vary, "*"))
+        return 0; // 요청 헤더 말고 다른 것에도 따라 달라지는 응답
+    // no-cache는 매번 재검증해야 하므로 validator가 있을 때만 저장할 의미가 있음
+    if (resp->no_cache && !resp->etag[0] && !resp->last_modified)
+        return 0;
+    return 1;
+}
+
+/*
+ * 응답이 신선한 상태로 남아 있는 마지막 시각. 우선순위는
+ * s-maxage > max-age > Expires - Date > Last-Modified 기반 추정(10%) > 기본값.
+ * 오는 동안 이미 흐른 시간(Age, Date와의 차이)은 빼준다.
+ */
+time_t response_expires_at(const HttpResponse *resp, time_t now){
+    time_t date = resp->date ? resp->date : now;
+    long lifetime, age;
+
+    if (resp->no_cache)
+        return now; // 저장은 하되 바로 stale -> 다음 요청 때 재검증
+    if (resp->s_maxage >= 0)
+        lifetime = resp->s_maxage;
+    else if (resp->max_age >= 0)
+        lifetime = resp->max_age;
+    else if (resp->expires)
+        lifetime = resp->expires - date;
+    else if (resp->last_modified && resp->last_modified < date)
+        lifetime = (date - resp->last_modified) / 10;
+    else
+        lifetime = http_default_ttl;
+
+    age = now > date ? now - date : 0;
+    if (resp->age > age)
+        age = resp->age;
+    return now + lifetime - age;
+}
+
+static int is_unreserved(int c){
+    return isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+/*
+ * 캐시 키로 쓸 정규화된 uri를 out에 만든다. 스킴과 호스트는 소문자로,
+ * 기본 포트(:80)는 빼고, 빈 path는 "/"로, %XX는 unreserved 문자면 풀고
+ * 아니면 16진수를 대문자로 맞춘다. #fragment는 서버로 가지 않으니 버린다.
+ * 결과 길이를 돌려주고, out이 모자라면 -1.
+ */
+int normalize_uri(const char *uri, char *out, size_t len){
+    const char *p = uri, *host, *hostend, *colon = NULL;
+    size_t n = 0;
+
+#define PUT(c) do { if (n + 1 >= len) return -1; out[n++] = (c); } while (0)
+    if ((host = strstr(uri, "://")) != NULL) {
+        for (; p < host + 3; p++)
+            PUT(tolower((unsigned char)*p));
+    }
+    host = p;
+    hostend = host + strcspn(host, "/?#");
+    for (; p < hostend; p++) {
+        if (*p == ':')
+            colon = p;
+        PUT(tolower((unsigned char)*p));
+    }
+    // "host:80"이나 "host:"면 포트 부분을 지운다
+    if (colon && (hostend - colon == 1 || (hostend - colon == 3 && !strncmp(colon, ":80", 3))))
+        n -= hostend - colon;
+
+    if (*p != '/')
+        PUT('/');
+    for (; *p && *p != '#'; p++) {
+        if (*p == '%' && isxdigit((unsigned char)p[1]) && isxdigit((unsigned char)p[2])) {
+            char hex[3] = { p[1], p[2], '\0' };
+            int c = (int)strtol(hex, NULL, 16);
+            if (is_unreserved(c))
+                PUT(c);
+            else {
+                PUT('%');
+                PUT(toupper((unsigned char)p[1]));
+                PUT(toupper((unsigned char)p[2]));
+            }
+            p += 2;
+        } else
+            PUT(*p);
+    }
+#undef PUT
+    out[n] = '\0';
+    return n;
+}
+
+/*
+ * vary("accept-encoding,user-agent,")에 적힌 헤더들만 요청 헤더
+ * 블록(headers)에서 골라 "accept-encoding: gzip\r\n" 꼴로 out에 적는다.
+ * 같은 uri의 변형(variant)을 구분하는 보조 키이면서, 그대로 원 서버
+ * 요청에 다시 붙일 수도 있다. 요청에 없는 헤더는 건너뛴다.
+ */
+void select_vary_headers(const char *vary, const char *headers, char *out, size_t len){
+    const char *name, *comma, *line, *next;
+    size_t n = 0;
+
+    out[0] = '\0';
+    for (name = vary; (comma = strchr(name, ',')) != NULL; name = comma + 1) {
+        size_t namelen = comma - name;
+        for (line = headers; *line; line = next) {
+            next = strstr(line, "\r\n");
+            next = next ? next + 2 : line + strlen(line);
+            if (!strncasecmp(line, name, namelen) && line[namelen] == ':') {
+                const char *v = header_value(line, namelen + 1);
+                int vlen = next - v;
+                while (vlen > 0 && isspace((unsigned char)v[vlen - 1])) vlen--;
+                n += snprintf(out + n, n < len ? len - n : 0, "%.*s: %.*s\r\n",
+                              (int)namelen, name, vlen, v);
+                break;
+            }
+        }
+    }
+    if (n >= len)
+        out[len - 1] = '\0';
+}
+
+//헤더 블록에서 name 헤더의 값(앞뒤 공백 제거)을 out에 복사. 있으면 1, 없으면 0
+int get_header(const char *headers, const char *name, char *out, size_t len){
+    size_t namelen = strlen(name);
+    const char *line, *next;
+
+    out[0] = '\0';
+    for (line = headers; *line; line = next) {
+        next = strstr(line, "\r\n");
+        next = next ? next + 2 : line + strlen(line);
+        if (!strncasecmp(line, name, namelen) && line[namelen] == ':') {
+            const char *v = header_value(line, namelen + 1);
+            size_t vlen = next - v;
+            while (vlen > 0 && isspace((unsigned char)v[vlen - 1])) vlen--;
+            if (vlen >= len) vlen = len - 1;
+            memcpy(out, v, vlen);
+            out[vlen] = '\0';
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//헤더 블록에서 name 헤더 줄을 모두 지운다
+void remove_header(char *headers, const char *name){
+    size_t namelen = strlen(name);
+    char *line = headers, *next;
+
+    while (*line) {
+        next = strstr(line, "\r\n");
+        next = next ? next + 2 : line + strlen(line);
+        if (!strncasecmp(line, name, namelen) && line[namelen] == ':')
+            memmove(line, next, strlen(next) + 1);
+        else
+            line = next;
+    }
+}
+
+/*
+ * Range 값 "bytes=a-b", "bytes=a-", "bytes=-n"을 길이 size인 본문의
+ * [first, last]로 바꾼다. 맞는 구간이면 1, 여러 구간처럼 지원하지 않는
+ * 형식이면 0(전체를 보냄), 본문 밖이면 -1(416). "bytes=-0"도 빈 구간이라 -1.
+ */
+int parse_byte_range(const char *spec, long size, long *first, long *last){
+    long a, b;
+    const char *p;
+
+    while (*spec == ' ' || *spec == '\t') spec++;
+    if (strncasecmp(spec, "bytes=", 6) || strchr(spec, ','))
+        return 0;
+    p = spec + 6;
+    // 접미 구간을 먼저 본다: "%ld"가 "-0"을 0으로 읽어서 "bytes=0-"(전체)로 오해하지 않게
+    if (*p == '-') {
+        if (sscanf(p + 1, "%ld", &b) != 1 || b < 0)
+            return 0;
+        if (b == 0)
+            return -1;
+        a = b > size ? 0 : size - b; // 마지막 b 바이트
+        b = size - 1;
+    } else if (sscanf(p, "%ld-%ld", &a, &b) == 2)
+        ;
+    else if (sscanf(p, "%ld-", &a) == 1 && a >= 0)
+        b = size - 1;
+    else
+        return 0;
+    if (a >= size)
+        return -1;
+    if (a < 0 || a > b)
+        return 0;
+    if (b >= size)
+        b = size - 1;
+    *first = a;
+    *last = b;
+    return 1;
+}
+
+/*
+ * 클라이언트의 Accept-Encoding을 "Accept-Encoding: gzip" 한 줄로 줄이거나
+ * (gzip을 받는 경우) 아예 지운다. 브라우저마다 값이 달라도 Vary 변형이
+ * gzip/identity 두 개로만 나뉘게 된다. gzip을 받으면 1.
+ * headers는 size 바이트 버퍼. 지운 줄보다 새 줄이 길 수 있어서 안 들어가면 붙이지 않는다
+ */
+int normalize_accept_encoding(char *headers, size_t size){
+    char value[HTTP_LINE], *save, *tok;
+    int gzip = 0;
+    size_t n;
+
+    if (!get_header(headers, "Accept-Encoding", value, sizeof(value)))
+        return 0;
+    for (tok = strtok_r(value, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        const char *q;
+        while (isspace((unsigned char)*tok)) tok++;
+        if (strncasecmp(tok, "gzip", 4) && strncmp(tok, "*", 1))
+            continue;
+        // "gzip;q=0"은 받지 않겠다는 뜻
+        q = strstr(tok, "q=");
+        if (q == NULL || atof(q + 2) > 0)
+            gzip = 1;
+    }
+    remove_header(headers, "Accept-Encoding");
+    n = strlen(headers);
+    if (gzip && (size_t)snprintf(headers + n, size - n, "Accept-Encoding: gzip\r\n") >= size - n)
+        headers[n] = '\0'; //잘린 헤더를 보내지 않게
+    return gzip;
+}
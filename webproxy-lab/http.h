@@ -0,0 +1,53 @@
+#ifndef __HTTP_H__
+#define __HTTP_H__
+
+#include <stddef.h>
+#include <time.h>
+
+#define HTTP_ETAG_LEN 128
+#define HTTP_VARY_LEN 256
+#define HTTP_TYPE_LEN 128
+
+/* 캐시 판단에 필요한 응답 헤더 정보 */
+typedef struct _HttpResponse{
+    int status;         // 상태 코드
+    int header_len;     // 상태 줄 + 헤더 + 빈 줄까지의 바이트 수
+    int no_store;       // Cache-Control: no-store
+    int is_private;     // Cache-Control: private
+    int no_cache;       // Cache-Control: no-cache (저장은 되지만 매번 재검증)
+    int set_cookie;     // Set-Cookie가 있음 (공유 캐시에 저장하면 안 됨)
+    int no_transform;   // Cache-Control: no-transform (프록시가 압축하면 안 됨)
+    int encoded;        // identity가 아닌 Content-Encoding이 이미 있음
+    long max_age;       // Cache-Control: max-age (없으면 -1)
+    long s_maxage;      // Cache-Control: s-maxage (없으면 -1)
+    long swr;           // Cache-Control: stale-while-revalidate (없으면 0)
+    long age;           // Age (없으면 0)
+    time_t date;        // Date (없으면 0)
+    time_t expires;     // Expires (없거나 잘못된 값이면 0)
+    time_t last_modified; // Last-Modified (없으면 0)
+    char etag[HTTP_ETAG_LEN]; // ETag (없으면 빈 문자열)
+    char vary[HTTP_VARY_LEN]; // Vary 헤더 이름들을 소문자로 ","로 이은 것 (없으면 빈 문자열)
+    long range_total;   // 206의 Content-Range: bytes a-b/전체길이 (없거나 모르면 -1)
+    char content_type[HTTP_TYPE_LEN]; // Content-Type (없으면 빈 문자열)
+} HttpResponse;
+
+/* Date/Last-Modified 등이 없을 때 쓰는 기본 유효 시간 (초) */
+#define HTTP_DEFAULT_TTL 300
+
+/* 설정(default_ttl, stale_while_revalidate)으로 바뀌는 값. 다음에 받는 응답부터 적용 */
+extern int http_default_ttl;
+extern int http_default_swr; // 응답에 stale-while-revalidate가 없을 때 (초)
+
+time_t parse_http_date(const char *s);
+void format_http_date(time_t t, char *buf, size_t len);
+int parse_response_headers(const char *buf, size_t len, HttpResponse *resp);
+int response_cacheable(const HttpResponse *resp);
+time_t response_expires_at(const HttpResponse *resp, time_t now);
+int normalize_uri(const char *uri, char *out, size_t len);
+void select_vary_headers(const char *vary, const char *headers, char *out, size_t len);
+int get_header(const char *headers, const char *name, char *out, size_t len);
+void remove_header(char *headers, const char *name);
+int parse_byte_range(const char *spec, long size, long *first, long *last);
+int normalize_accept_encoding(char *headers, size_t size);
+
+#endif /* __HTTP_H__ */
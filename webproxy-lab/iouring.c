@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "iouring.h"
+#include "stats.h"
+
+/* 커널에게 받는 완료(cqe)의 종류 */
+#define IO_RECV 1
+#define IO_SEND 2
+#define IO_CANCEL 3
+
+int io_engine = IO_SYNC;
+
+static IoRing *free_rings; //다 쓰고 돌려놓은 링들
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int sys_setup(unsigned entries, struct io_uring_params *p){
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags){
+    STAT_ADD(io_uring_enters, 1);
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void free_ring(IoRing *ring){
+    if (ring->sq_ptr) munmap(ring->sq_ptr, ring->sq_len);
+    if (ring->cq_ptr) munmap(ring->cq_ptr, ring->cq_len);
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_len);
+    free(ring->bufs[0]);
+    close(ring->fd);
+    free(ring);
+}
+
+//링을 만들고 중계 슬롯들을 등록한다. 커널이 io_uring을 못 쓰게 하면 NULL
+static IoRing *new_ring(){
+    struct io_uring_params p;
+    struct iovec iov[IO_RELAY_SLOTS];
+    IoRing *ring = calloc(1, sizeof(IoRing));
+
+    if (ring == NULL) return NULL;
+    memset(&p, 0, sizeof(p));
+    if ((ring->fd = sys_setup(IO_RING_ENTRIES, &p)) < 0) {
+        free(ring);
+        return NULL;
+    }
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ptr == MAP_FAILED) ring->sq_ptr = NULL;
+    if (ring->cq_ptr == MAP_FAILED) ring->cq_ptr = NULL;
+    if (ring->sqes == MAP_FAILED) ring->sqes = NULL;
+    if (!ring->sq_ptr || !ring->cq_ptr || !ring->sqes) {
+        free_ring(ring);
+        return NULL;
+    }
+    ring->sq_head = (unsigned *)((char *)ring->sq_ptr + p.sq_off.head);
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ptr + p.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + p.cq_off.cqes);
+
+    // 버퍼를 미리 등록해 두면 recv마다 커널이 페이지를 다시 고정하지 않는다
+    if ((ring->bufs[0] = malloc(IO_RELAY_HIGH)) == NULL) {
+        free_ring(ring);
+        return NULL;
+    }
+    for (int i = 0; i < IO_RELAY_SLOTS; i++) {
+        ring->bufs[i] = ring->bufs[0] + i * IO_RELAY_BUF;
+        iov[i].iov_base = ring->bufs[i];
+        iov[i].iov_len = IO_RELAY_BUF;
+    }
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS, iov, IO_RELAY_SLOTS) < 0) {
+        free_ring(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+static IoRing *get_ring(){
+    IoRing *ring;
+
+    pthread_mutex_lock(&ring_lock);
+    if ((ring = free_rings) != NULL)
+        free_rings = ring->next;
+    pthread_mutex_unlock(&ring_lock);
+    return ring ? ring : new_ring();
+}
+
+static void put_ring(IoRing *ring){
+    pthread_mutex_lock(&ring_lock);
+    ring->next = free_rings;
+    free_rings = ring;
+    pthread_mutex_unlock(&ring_lock);
+}
+
+//빈 SQE 하나를 채워 큐에 올린다 (커널에 넘기는 건 다음 sys_enter에서)
+static struct io_uring_sqe *push_sqe(IoRing *ring){
+    unsigned tail = *ring->sq_tail;
+    unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    return sqe;
+}
+
+#define SLOT(seq) ((seq) % IO_RELAY_SLOTS)
+
+//send_seq 슬롯의 (남은) 데이터를 보내는 SQE를 올린다
+static void queue_send(IoRelay *r){
+    int i = SLOT(r->send_seq);
+    struct io_uring_sqe *sqe = push_sqe(r->ring);
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = r->dst;
+    sqe->addr = (unsigned long)(r->ring->bufs[i] + r->send_off[i]);
+    sqe->len = r->send_len[i];
+    sqe->msg_flags = MSG_NOSIGNAL; //클라이언트가 끊어도 SIGPIPE 대신 에러로 받음
+    sqe->user_data = IO_SEND;
+    r->sending = 1;
+}
+
+/*
+ * 할 수 있는 일을 다 큐에 올린다: 다 쓴 슬롯을 비우고, 다음 send를 올리고,
+ * 창에 자리가 있으면 원 서버에서 다음 덩어리를 미리 받는다.
+ */
+static void pump(IoRelay *r){
+    struct io_uring_sqe *sqe;
+    int i;
+
+    // send는 순서대로 하나씩 (TCP에 여러 개 걸면 일부만 나갔을 때 섞일 수 있음)
+    while (!r->sending && r->send_seq != r->read_seq) {
+        i = SLOT(r->send_seq);
+        if (r->state[i] == SLOT_SEND && !r->error) {
+            queue_send(r);
+            break;
+        }
+        if (r->state[i] == SLOT_HANDED)
+            break; //호출한 쪽이 아직 쓰는 중
+        r->state[i] = SLOT_DONE; //안 보내고 놓은 슬롯, 또는 클라이언트가 끊겨 버린 슬롯
+        r->send_seq++;
+    }
+    while (r->free_seq != r->send_seq && r->state[i = SLOT(r->free_seq)] == SLOT_DONE) {
+        r->buffered -= r->len[i] > 0 ? r->len[i] : 0;
+        r->state[i] = SLOT_FREE;
+        r->free_seq++;
+    }
+
+    if (r->paused && r->buffered <= IO_RELAY_LOW)
+        r->paused = 0;
+    if (r->recv_pending || r->recv_eof || r->cancelling || r->paused)
+        return;
+    if (r->buffered + IO_RELAY_BUF > IO_RELAY_HIGH) {
+        r->paused = 1; //클라이언트가 따라올 때까지 원 서버 읽기를 멈춤
+        STAT_ADD(relay_pauses, 1);
+        return;
+    }
+    if (r->recv_seq - r->free_seq == IO_RELAY_SLOTS)
+        return; //작은 덩어리들로 슬롯이 먼저 찬 경우. 하나 비면 바로 이어서 받음
+    i = SLOT(r->recv_seq);
+    sqe = push_sqe(r->ring);
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = r->src;
+    sqe->off = -1;
+    sqe->addr = (unsigned long)r->ring->bufs[i];
+    sqe->len = IO_RELAY_BUF;
+    sqe->buf_index = i;
+    sqe->user_data = IO_RECV;
+    r->state[i] = SLOT_RECV;
+    r->buffered += IO_RELAY_BUF; //받기 전까지는 슬롯 전체를 잡아 둠
+    r->recv_pending = 1;
+    r->recv_seq++;
+}
+
+//완료된 cqe를 모두 처리한다. 덜 보낸 send는 나머지를 다시 큐에 올림
+static void reap_cqes(IoRelay *r){
+    IoRing *ring = r->ring;
+    unsigned head = *ring->cq_head;
+
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        int i;
+        if (cqe->user_data == IO_RECV) {
+            i = SLOT(r->recv_seq - 1);
+            r->len[i] = cqe->res < 0 ? -1 : cqe->res;
+            r->buffered -= IO_RELAY_BUF - (cqe->res > 0 ? cqe->res : 0);
+            r->state[i] = SLOT_FILLED;
+            r->recv_pending = 0;
+            if (cqe->res <= 0)
+                r->recv_eof = 1;
+        }
+        else if (cqe->user_data == IO_SEND) {
+            i = SLOT(r->send_seq);
+            r->sending = 0;
+            if (cqe->res <= 0)
+                r->error = 1; //남은 send는 pump가 버린다
+            else if ((size_t)cqe->res < r->send_len[i]) {
+                r->send_off[i] += cqe->res;
+                r->send_len[i] -= cqe->res;
+                queue_send(r);
+                head++;
+                continue;
+            }
+            r->state[i] = SLOT_DONE;
+            r->send_seq++;
+        }
+        else
+            r->cancelling = 0;
+        head++;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    pump(r);
+}
+
+static int slot_ready(IoRelay *r){
+    return r->read_seq != r->recv_seq && r->state[SLOT(r->read_seq)] == SLOT_FILLED;
+}
+
+static int relay_idle(IoRelay *r){
+    return !r->sending && !r->recv_pending && !r->cancelling && r->send_seq == r->read_seq;
+}
+
+//쌓인 SQE를 넘기면서 done(r)이 참이 될 때까지 기다린다
+static void wait_until(IoRelay *r, int (*done)(IoRelay *)){
+    reap_cqes(r);
+    while (!done(r)) {
+        unsigned n = r->ring->to_submit;
+        if (sys_enter(r->ring->fd, n, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            r->error = r->broken = 1;
+            return;
+        }
+        r->ring->to_submit = 0;
+        reap_cqes(r);
+    }
+}
+
+/*
+ * 엔진을 고른다. io_uring을 골랐는데 커널이 지원하지 않으면(또는 막혀 있으면)
+ * sync로 돌아간다. 실제로 쓰게 된 엔진을 돌려줌
+ */
+int io_init(int engine){
+    IoRing *ring;
+
+    io_engine = IO_SYNC;
+    if (engine == IO_URING) {
+        if ((ring = new_ring()) == NULL) {
+            fprintf(stderr, "io_uring unavailable (%s), using blocking I/O\n", strerror(errno));
+            return io_engine;
+        }
+        put_ring(ring);
+        io_engine = IO_URING;
+    }
+    return io_engine;
+}
+
+/* sync_buf는 sync로 돌 때 읽어 넣을 버퍼 (IO_RELAY_BUF 이상) */
+void io_relay_begin(IoRelay *r, rio_t *rp, char *sync_buf, int src, int dst){
+    memset(r, 0, sizeof(*r));
+    r->rp = rp;
+    r->sync_buf = r->buf = sync_buf;
+    r->cap = r->want = IO_RELAY_BUF;
+    r->src = src;
+    r->dst = dst;
+    if (io_engine == IO_URING)
+        r->ring = get_ring(); //못 만들면 이 연결만 sync로
+}
+
+//sync 중계 버퍼를 size로 바꾼다. 내용은 버려도 되는 시점에만 부름 (못 늘리면 그대로)
+static void sync_resize(IoRelay *r, size_t size){
+    char *buf;
+
+    if (size == r->cap)
+        return;
+    if (size <= IO_RELAY_BUF)
+        buf = r->sync_buf;
+    else if ((buf = malloc(size)) == NULL)
+        return;
+    if (r->buf != r->sync_buf)
+        free(r->buf);
+    r->buf = buf;
+    r->cap = size <= IO_RELAY_BUF ? IO_RELAY_BUF : size;
+}
+
+/*
+ * 헤더가 든 첫 덩어리는 지금처럼 rio로 IO_RELAY_BUF만큼 채운다 (파싱과 gzip 판단은
+ * 첫 덩어리에 헤더가 다 있다고 봄). 그 뒤로는 rio_buf에 남은 것만 털어내고
+ * 소켓에서 중계 버퍼로 바로 읽어 복사 한 번을 아낀다.
+ */
+static ssize_t sync_read(IoRelay *r, char **bufp){
+    ssize_t n;
+
+    if (!r->headers_read || r->rp->rio_cnt > 0) {
+        n = r->headers_read ? r->rp->rio_cnt : IO_RELAY_BUF;
+        r->headers_read = 1;
+        *bufp = r->sync_buf;
+        return rio_readnb(r->rp, r->sync_buf, n);
+    }
+    sync_resize(r, r->want);
+    while (1) {
+        rio_count_syscall();
+        if ((n = read(r->src, r->buf, r->cap)) >= 0)
+            break;
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            return -1;
+        // 쉬는 연결(코루틴 모드)은 기다리는 동안 작은 버퍼만 들고 있는다
+        sync_resize(r, IO_RELAY_BUF);
+        if (rio_wait(r->src, POLLIN) < 0)
+            return -1;
+    }
+    // 버퍼를 다 채웠으면 원 서버가 더 빨리 주는 중이므로 키우고, 조금만 왔으면 줄인다.
+    // 호출한 쪽이 아직 이 버퍼를 쓰므로 실제로 바꾸는 건 다음 읽기 직전
+    if ((size_t)n == r->cap && r->cap < IO_RELAY_MAX)
+        r->want = r->cap * 2;
+    else if ((size_t)n < r->cap / 4 && r->cap > IO_RELAY_BUF)
+        r->want = r->cap / 2;
+    else
+        r->want = r->cap;
+    *bufp = r->buf;
+    return n;
+}
+
+//호출한 쪽이 들고 있던 슬롯을 놓는다 (io_relay_write로 넘겼으면 보내고 나서 비워짐)
+static void release_handed(IoRelay *r){
+    int i = SLOT(r->read_seq - 1);
+
+    if (r->state[i] == SLOT_HANDED)
+        r->state[i] = SLOT_DONE;
+}
+
+/*
+ * 원 서버에서 다음 덩어리를 읽어 *bufp로 알려준다. 읽은 바이트 수, EOF면 0, 에러면 -1.
+ * 버퍼는 다음 io_relay_read 전까지만 유효하다.
+ */
+ssize_t io_relay_read(IoRelay *r, char **bufp){
+    int i;
+
+    if (r->ring == NULL)
+        return sync_read(r, bufp);
+    release_handed(r);
+    // 미리 받아 둔 게 있으면 syscall 없이 바로 넘긴다 (올려둔 SQE는 다음 대기 때 같이 넘어감)
+    wait_until(r, slot_ready);
+    if (r->broken)
+        return -1;
+    i = SLOT(r->read_seq++);
+    r->state[i] = SLOT_HANDED;
+    *bufp = r->ring->bufs[i];
+    return r->len[i];
+}
+
+/*
+ * buf를 클라이언트로 보낸다. io_uring이면 큐에만 올리고 다음 io_relay_read와
+ * 같이 넘긴다. 그래서 buf는 방금 io_relay_read가 준 슬롯 안이어야 한다.
+ * 클라이언트가 끊겼으면 -1
+ */
+int io_relay_write(IoRelay *r, char *buf, size_t n){
+    int i;
+
+    if (r->ring == NULL) {
+        Rio_writen(r->dst, buf, n);
+        return 0;
+    }
+    if (r->error)
+        return -1;
+    i = SLOT(r->read_seq - 1);
+    r->send_off[i] = buf - r->ring->bufs[i];
+    r->send_len[i] = n;
+    r->state[i] = SLOT_SEND;
+    pump(r);
+    return 0;
+}
+
+/*
+ * 남은 send를 다 보내고 링을 풀에 돌려놓는다. 중간에 그만뒀으면 걸려 있는 recv를
+ * 취소한다 (등록된 슬롯에 나중에 써넣으면 안 되므로). io_uring_enter가 실패했던 링은
+ * 커널에 무엇이 남았는지 모르므로 재사용하지 않고 닫는다.
+ */
+void io_relay_end(IoRelay *r){
+    if (r->ring == NULL) {
+        sync_resize(r, IO_RELAY_BUF);
+        return;
+    }
+    release_handed(r);
+    r->recv_eof = 1; //더 받지 않음
+    if (r->recv_pending) {
+        struct io_uring_sqe *sqe = push_sqe(r->ring);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = IO_RECV;
+        sqe->user_data = IO_CANCEL;
+        r->cancelling = 1;
+    }
+    wait_until(r, relay_idle);
+    if (r->broken)
+        free_ring(r->ring);
+    else
+        put_ring(r->ring);
+    r->ring = NULL;
+}
@@ -0,0 +1,88 @@
+#ifndef __IOURING_H__
+#define __IOURING_H__
+
+#include <pthread.h>
+#include <linux/io_uring.h>
+#include "csapp.h"
+
+/* 응답 중계에 쓰는 I/O 엔진 (-e) */
+enum { IO_SYNC, IO_URING };
+
+#define IO_RING_ENTRIES 8
+#define IO_RELAY_BUF MAXBUF //중계 슬롯 하나 크기
+#define IO_RELAY_SLOTS 8    //링마다 커널에 등록해 두는 슬롯 수
+/*
+ * 연결 하나가 쌓아둘 수 있는 응답 바이트 (흐름 제어). 클라이언트가 느려서
+ * 보내지 못한 게 HIGH만큼 쌓이면 원 서버 읽기를 멈추고, LOW 아래로 빠지면 다시 읽는다.
+ * 응답 크기나 클라이언트 속도와 상관없이 연결당 메모리는 HIGH(64KB)를 넘지 않음
+ */
+#define IO_RELAY_HIGH (IO_RELAY_SLOTS * IO_RELAY_BUF)
+#define IO_RELAY_LOW (IO_RELAY_HIGH / 2)
+/*
+ * sync 중계 버퍼가 커질 수 있는 최대 크기. 읽을 때마다 버퍼가 꽉 차면(원 서버가 우리보다
+ * 빠름) 두 배로, 1/4도 못 채우면 절반으로. 기다려야 하면(EAGAIN) IO_RELAY_BUF로 돌아감
+ */
+#define IO_RELAY_MAX (256 * 1024)
+
+/*
+ * io_uring 하나 (liburing 없이 syscall + mmap으로 직접 씀).
+ * 만들 때 중계 슬롯들을 등록해 두고, 다 쓴 링은 풀에 돌려놓아 다음 연결이 재사용한다.
+ */
+typedef struct _IoRing{
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned to_submit; //채워놓고 아직 커널에 안 넘긴 SQE 수
+    char *bufs[IO_RELAY_SLOTS]; //등록된 중계 슬롯
+    struct _IoRing *next;
+} IoRing;
+
+/* 중계 슬롯 하나의 상태. 슬롯은 번호(seq) 순서대로 돌아가며 쓴다 */
+enum { SLOT_FREE, SLOT_RECV, SLOT_FILLED, SLOT_HANDED, SLOT_SEND, SLOT_DONE };
+
+/*
+ * 원 서버(src) -> 클라이언트(dst) 중계 하나.
+ * io_uring이면 슬롯들을 창(window)으로 써서 클라이언트로 보내는 동안에도 원 서버에서
+ * 미리 받아 둔다. send와 다음 recv는 한 번의 io_uring_enter로 같이 넘긴다.
+ * 링이 없으면 헤더가 든 첫 덩어리는 rio로 읽고, 그다음부터는 rio_buf를 거치지 않고
+ * 소켓에서 중계 버퍼로 바로 읽는다. 버퍼 크기는 IO_RELAY_BUF~IO_RELAY_MAX 사이에서
+ * 처리량에 맞춰 바뀜 (막히는 Rio_writen이 곧 흐름 제어라서 버퍼는 하나).
+ *
+ * 슬롯 번호는 free_seq <= send_seq <= read_seq <= recv_seq 순서를 지킨다.
+ * [free_seq, recv_seq)가 쓰는 중인 슬롯이고 buffered는 그 안의 바이트.
+ */
+typedef struct _IoRelay{
+    IoRing *ring;       //NULL이면 sync
+    rio_t *rp;          //sync일 때 읽는 rio
+    char *sync_buf;     //sync일 때 읽어 넣을 버퍼 (IO_RELAY_BUF 이상)
+    char *buf;          //sync 중계 버퍼 (sync_buf이거나 malloc한 더 큰 버퍼)
+    size_t cap, want;   //지금 크기, 다음 읽기 전에 바꿀 크기
+    int headers_read;   //첫 덩어리(헤더)를 rio로 읽었음
+    int src, dst;
+    unsigned recv_seq;  //다음 recv를 넣을 슬롯
+    unsigned read_seq;  //호출한 쪽에 다음에 넘겨줄 슬롯
+    unsigned send_seq;  //다음에 보낼 슬롯
+    unsigned free_seq;  //아직 재사용할 수 없는 가장 오래된 슬롯
+    int state[IO_RELAY_SLOTS];
+    ssize_t len[IO_RELAY_SLOTS];     //받은 바이트 (EOF면 0, 에러면 -1)
+    size_t send_off[IO_RELAY_SLOTS], send_len[IO_RELAY_SLOTS];
+    size_t buffered;    //창 안의 바이트 (recv 중인 슬롯은 IO_RELAY_BUF로 침)
+    int paused;         //HIGH에 닿아 원 서버 읽기를 멈춤 (LOW까지 빠지면 풀림)
+    int recv_pending, recv_eof, sending, cancelling;
+    int error;          //클라이언트로 보내다 실패함 (이후 쓰기는 버림)
+    int broken;         //io_uring_enter 자체가 실패함 (링을 버림)
+} IoRelay;
+
+extern int io_engine;
+
+int io_init(int engine);
+void io_relay_begin(IoRelay *r, rio_t *rp, char *sync_buf, int src, int dst);
+ssize_t io_relay_read(IoRelay *r, char **bufp);
+int io_relay_write(IoRelay *r, char *buf, size_t n);
+void io_relay_end(IoRelay *r);
+
+#endif /* __IOURING_H__ */
@@ -0,0 +1,386 @@
+/*
+ * loadgen.c - HTTP load generator for tiny and the proxy.
+ *
+ *     echoclient처럼 Open_clientfd + Rio로 요청을 보내지만, 연결 N개를
+ *     스레드 N개로 동시에 돌리고 요청별 지연 시간을 모아서 분포를 낸다.
+ *
+ *     closed-loop (기본): 각 연결이 응답을 받자마자 다음 요청을 보낸다.
+ *     open-loop (-r): 전체 rate req/s에 맞춰 요청 시작 시각을 미리 정해두고,
+ *         지연 시간을 "실제로 보낸 시각"이 아니라 "보냈어야 할 시각"부터 잰다.
+ *         서버가 느려져서 요청이 밀려도 그 대기 시간이 결과에 그대로
+ *         잡히므로 coordinated omission이 생기지 않는다.
+ *
+ *     URI는 인자로 준 순서대로 인기 순위로 보고 Zipf(s) 분포로 고른다.
+ *     s=0 이면 균등 분포. -b 를 주면 URI마다 ?b=<번호>를 붙여서 프록시
+ *     캐시를 항상 미스시킨다 (tiny는 정적 파일의 query string을 무시함).
+ *
+ *     -R len:span 을 주면 매 요청에 [0, span) 안의 임의 위치부터 len 바이트를
+ *     달라는 Range 헤더를 붙인다 (동영상 탐색 같은 부분 요청 부하).
+ *
+ *     -H "Name: value" 는 모든 요청에 헤더 한 줄을 더 붙인다 (여러 번 줄 수 있음).
+ *
+ *     -m 은 결과를 bench.sh가 모으기 좋은 탭 구분 한 줄로 출력한다:
+ *         requests errors secs rps mbps p50_us p99_us p999_us max_us
+ *
+ *     usage: ./loadgen [-c conns] [-d secs] [-n reqs] [-r rate] [-k] [-b]
+ *                      [-m] [-z s] [-t timeout_ms] [-R len:span] [-H header]
+ *                      [-x proxyhost:port] <host> <port> <uri> [uri ...]
+ */
+#include "csapp.h"
+#include <stdint.h>
+#include <time.h>
+
+typedef struct {
+    int id;
+    int fd;                 // keep-alive 연결 (없으면 -1)
+    unsigned seed;
+    uint64_t *lat;          // 요청별 지연 (ns)
+    size_t nlat, cap;
+    unsigned long errors;
+    unsigned long long bytes;
+    int connect_fails;      // 연달아 연결에 실패한 횟수 (재시도 간격을 늘리는 데 씀)
+} worker_t;
+
+/* 설정 (main에서 한 번 정하고 스레드들은 읽기만 함) */
+static int nconns = 1;
+static double duration = 10.0;
+static long max_requests = 0;    // 0이면 무제한 (duration만 봄)
+static double rate = 0;          // 0이면 closed-loop
+static int keepalive = 0;
+static int cache_bust = 0;
+static int machine = 0;
+static double zipf_s = 0;
+static int timeout_ms = 5000;
+static long range_len = 0, range_span = 0; // -R (0이면 Range 없이 전체 요청)
+static char extra_headers[MAXLINE];         // -H로 준 헤더들 ("\r\n"으로 끝남)
+static char *host, *port;
+static char *proxy_host = NULL, *proxy_port = NULL;
+static char **uris;
+static int nuris;
+static double *zipf_cdf;
+
+#define BACKOFF_MIN_NS 1000000ull     // 연결 실패 후 첫 재시도 간격 (1ms)
+#define BACKOFF_MAX_NS 1000000000ull  // 최대 1초
+
+static uint64_t t_start, t_end;
+static long issued = 0;          // 지금까지 보낸 요청 수 (-n용)
+
+static uint64_t now_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t){
+    struct timespec ts = { t / 1000000000ull, t % 1000000000ull };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+/* 순위 k(1..n)의 확률이 1/k^s 에 비례하도록 누적분포를 만든다 */
+static void build_zipf(){
+    double sum = 0;
+    int i;
+
+    zipf_cdf = Malloc(nuris * sizeof(double));
+    for (i = 0; i < nuris; i++) {
+        sum += 1.0 / pow(i + 1, zipf_s);
+        zipf_cdf[i] = sum;
+    }
+    for (i = 0; i < nuris; i++)
+        zipf_cdf[i] /= sum;
+}
+
+static char *pick_uri(worker_t *w){
+    double u = (double)rand_r(&w->seed) / ((double)RAND_MAX + 1);
+    int lo = 0, hi = nuris - 1;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (zipf_cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return uris[lo];
+}
+
+static int connect_target(){
+    int fd;
+    struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+
+    if (proxy_host)
+        fd = open_clientfd(proxy_host, proxy_port);
+    else
+        fd = open_clientfd(host, port);
+    if (fd < 0)
+        return -1;
+    // 응답이 안 오는 서버(nop-server 등)에 영원히 묶이지 않도록
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+/*
+ * 요청 하나를 보내고 응답을 끝까지 읽는다. 받은 바이트 수를 리턴하고
+ * 실패하면 -1. keep-alive면 Content-Length만큼만 읽고 연결을 남겨둔다.
+ */
+static long do_request(worker_t *w, char *uri, long seq){
+    char buf[MAXLINE], busted[MAXLINE];
+    rio_t rio;
+    long total = 0, clen = -1;
+    int close_after = !keepalive;
+    ssize_t n;
+    size_t len;
+
+    if (cache_bust) {
+        if (snprintf(busted, sizeof(busted), "%s?b=%d-%ld", uri, w->id, seq) >= (int)sizeof(busted))
+            return -1;
+        uri = busted;
+    }
+
+    //인자로 받은 host/uri가 길면 잘린 요청을 보내지 않고 에러로 센다
+    if (proxy_host)
+        len = snprintf(buf, sizeof(buf), "GET http://%s:%s%s HTTP/1.%d\r\n", host, port, uri, keepalive);
+    else
+        len = snprintf(buf, sizeof(buf), "GET %s HTTP/1.%d\r\n", uri, keepalive);
+    if (len < sizeof(buf))
+        len += snprintf(buf + len, sizeof(buf) - len, "Host: %s:%s\r\nConnection: %s\r\n",
+                        host, port, keepalive ? "keep-alive" : "close");
+    if (len < sizeof(buf) && range_len > 0) {
+        long first = range_span > range_len ? rand_r(&w->seed) % (range_span - range_len + 1) : 0;
+        len += snprintf(buf + len, sizeof(buf) - len, "Range: bytes=%ld-%ld\r\n", first, first + range_len - 1);
+    }
+    if (len < sizeof(buf))
+        len += snprintf(buf + len, sizeof(buf) - len, "%s\r\n", extra_headers);
+    if (len >= sizeof(buf))
+        return -1;
+
+    if (w->fd < 0) {
+        if ((w->fd = connect_target()) < 0) {
+            w->connect_fails++;
+            return -1;
+        }
+        w->connect_fails = 0;
+    }
+    if (rio_writen(w->fd, buf, len) < 0)
+        goto fail;
+
+    // 상태 줄 + 헤더
+    Rio_readinitb(&rio, w->fd);
+    while ((n = rio_readlineb(&rio, buf, MAXLINE)) > 0) {
+        total += n;
+        if (!strcmp(buf, "\r\n") || !strcmp(buf, "\n"))
+            break;
+        if (!strncasecmp(buf, "Content-length:", 15))
+            clen = atol(buf + 15);
+        else if (!strncasecmp(buf, "Connection: close", 17))
+            close_after = 1;
+    }
+    if (n <= 0)
+        goto fail;
+
+    // 본문: 길이를 알고 keep-alive면 그만큼만, 아니면 EOF까지
+    if (!close_after && clen >= 0) {
+        while (clen > 0) {
+            size_t want = clen < MAXLINE ? clen : MAXLINE;
+            if ((n = rio_readnb(&rio, buf, want)) <= 0)
+                goto fail;
+            total += n;
+            clen -= n;
+        }
+    } else {
+        while ((n = rio_readnb(&rio, buf, MAXLINE)) > 0)
+            total += n;
+        if (n < 0)
+            goto fail;
+        close(w->fd);
+        w->fd = -1;
+    }
+    return total;
+
+fail:
+    close(w->fd);
+    w->fd = -1;
+    return -1;
+}
+
+static void record(worker_t *w, uint64_t lat){
+    if (w->nlat == w->cap) {
+        w->cap = w->cap ? w->cap * 2 : 4096;
+        w->lat = Realloc(w->lat, w->cap * sizeof(uint64_t));
+    }
+    w->lat[w->nlat++] = lat;
+}
+
+static void *worker(void *vargp){
+    worker_t *w = vargp;
+    uint64_t intended = t_start, interval = 0;
+    long k;
+
+    if (rate > 0) {
+        // 각 연결이 rate/nconns 씩 맡고, 시작 시각을 엇갈리게 둔다
+        interval = (uint64_t)(1e9 * nconns / rate);
+        intended = t_start + interval * w->id / nconns;
+    }
+
+    for (k = 0; ; k++) {
+        uint64_t t0, t1;
+        long n;
+
+        if (max_requests && __sync_fetch_and_add(&issued, 1) >= max_requests)
+            break;
+        if (rate > 0) {
+            if (intended >= t_end)
+                break;
+            sleep_until(intended);
+            t0 = intended;           // 밀린 시간도 지연에 포함
+            intended += interval;
+        } else {
+            t0 = now_ns();
+            if (t0 >= t_end)
+                break;
+        }
+
+        n = do_request(w, pick_uri(w), k);
+        t1 = now_ns();
+        if (n < 0) {
+            w->errors++;
+            // 서버가 내려가 있으면 쉬지 않고 다시 붙지 않도록 실패할 때마다 간격을 두 배로
+            if (w->connect_fails) {
+                int shift = w->connect_fails < 11 ? w->connect_fails - 1 : 10;
+                uint64_t wait = BACKOFF_MIN_NS << shift;
+                if (wait > BACKOFF_MAX_NS)
+                    wait = BACKOFF_MAX_NS;
+                sleep_until(t1 + wait < t_end ? t1 + wait : t_end);
+            }
+            continue;
+        }
+        w->bytes += n;
+        record(w, t1 - t0);
+    }
+    if (w->fd >= 0)
+        close(w->fd);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double pct_us(uint64_t *v, size_t n, double p){
+    size_t rank;
+    if (n == 0) return 0;
+    rank = (size_t)(p * n);
+    if (rank >= n) rank = n - 1;
+    return v[rank] / 1000.0;
+}
+
+static void usage(char *prog){
+    fprintf(stderr, "usage: %s [-c conns] [-d secs] [-n reqs] [-r rate] [-k] [-b] "
+            "[-m] [-z s] [-t timeout_ms] [-R len:span] [-H header] [-x proxyhost:port] <host> <port> <uri> [uri ...]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv){
+    worker_t *workers;
+    pthread_t *tids;
+    uint64_t *all, t_done;
+    size_t nall = 0;
+    unsigned long errors = 0;
+    unsigned long long bytes = 0;
+    double secs;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "c:d:n:r:kbmz:t:R:H:x:")) != -1) {
+        switch (opt) {
+        case 'c': nconns = atoi(optarg); break;
+        case 'd': duration = atof(optarg); break;
+        case 'n': max_requests = atol(optarg); break;
+        case 'r': rate = atof(optarg); break;
+        case 'k': keepalive = 1; break;
+        case 'b': cache_bust = 1; break;
+        case 'm': machine = 1; break;
+        case 'z': zipf_s = atof(optarg); break;
+        case 't': timeout_ms = atoi(optarg); break;
+        case 'H':
+            if (strlen(extra_headers) + strlen(optarg) + 3 > MAXLINE)
+                usage(argv[0]);
+            strcat(extra_headers, optarg);
+            strcat(extra_headers, "\r\n");
+            break;
+        case 'R':
+            if (sscanf(optarg, "%ld:%ld", &range_len, &range_span) != 2 || range_len <= 0)
+                usage(argv[0]);
+            break;
+        case 'x':
+            proxy_host = optarg;
+            if ((proxy_port = strrchr(optarg, ':')) == NULL)
+                usage(argv[0]);
+            *proxy_port++ = '\0';
+            break;
+        default: usage(argv[0]);
+        }
+    }
+    if (argc - optind < 3 || nconns < 1)
+        usage(argv[0]);
+    host = argv[optind];
+    port = argv[optind + 1];
+    uris = &argv[optind + 2];
+    nuris = argc - optind - 2;
+    //요청 줄과 헤더가 한 버퍼(MAXLINE)에 들어가야 한다 (GET/Host/Range 등 고정 부분과 ?b= 자리로 128바이트 여유)
+    for (i = 0; i < nuris; i++)
+        if (strlen(uris[i]) + strlen(host) + strlen(port) + strlen(extra_headers) + 128 > MAXLINE) {
+            fprintf(stderr, "uri too long: %.64s...\n", uris[i]);
+            usage(argv[0]);
+        }
+    build_zipf();
+    Signal(SIGPIPE, SIG_IGN);
+
+    workers = Calloc(nconns, sizeof(worker_t));
+    tids = Malloc(nconns * sizeof(pthread_t));
+    t_start = now_ns();
+    t_end = t_start + (uint64_t)(duration * 1e9);
+    for (i = 0; i < nconns; i++) {
+        workers[i].id = i;
+        workers[i].fd = -1;
+        workers[i].seed = 0x9e3779b9u * (i + 1);
+        Pthread_create(&tids[i], NULL, worker, &workers[i]);
+    }
+    for (i = 0; i < nconns; i++) {
+        Pthread_join(tids[i], NULL);
+        nall += workers[i].nlat;
+        errors += workers[i].errors;
+        bytes += workers[i].bytes;
+    }
+    t_done = now_ns();
+
+    all = Malloc((nall ? nall : 1) * sizeof(uint64_t));
+    nall = 0;
+    for (i = 0; i < nconns; i++) {
+        memcpy(all + nall, workers[i].lat, workers[i].nlat * sizeof(uint64_t));
+        nall += workers[i].nlat;
+    }
+    qsort(all, nall, sizeof(uint64_t), cmp_u64);
+
+    secs = (t_done - t_start) / 1e9;
+    if (machine) {
+        printf("%zu\t%lu\t%.2f\t%.1f\t%.2f\t%.0f\t%.0f\t%.0f\t%.0f\n",
+               nall, errors, secs, nall / secs, bytes / secs / 1e6,
+               pct_us(all, nall, 0.50), pct_us(all, nall, 0.99),
+               pct_us(all, nall, 0.999), nall ? all[nall - 1] / 1000.0 : 0);
+        return 0;
+    }
+    printf("%s, %d conns, %s, zipf s=%.2f, %d uris\n",
+           rate > 0 ? "open-loop" : "closed-loop", nconns,
+           keepalive ? "keep-alive" : "one-shot", zipf_s, nuris);
+    if (rate > 0)
+        printf("target rate: %.0f req/s\n", rate);
+    printf("requests: %zu  errors: %lu  time: %.2f s\n", nall, errors, secs);
+    printf("throughput: %.1f req/s  %.2f MB/s\n", nall / secs, bytes / secs / 1e6);
+    printf("latency(us): p50 %.0f  p99 %.0f  p999 %.0f  max %.0f\n",
+           pct_us(all, nall, 0.50), pct_us(all, nall, 0.99),
+           pct_us(all, nall, 0.999), nall ? all[nall - 1] / 1000.0 : 0);
+    return 0;
+}
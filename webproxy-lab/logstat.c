@@ -0,0 +1,93 @@
+/*
+ * logstat.c - proxy -l 로 남긴 바이너리 access log를 읽어서
+ *     단계별 지연 시간 분포(percentile)를 출력한다.
+ *
+ *     usage: ./logstat <accesslog>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "accesslog.h"
+
+static const char *phase_names[NPHASE] = {
+    "parse", "lookup", "connect", "ttfb", "transfer"
+};
+
+static int cmp_u32(const void *a, const void *b){
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+//정렬된 배열에서 p 분위수 (nearest-rank)
+static uint32_t percentile(uint32_t *v, size_t n, double p){
+    size_t rank;
+    if (n == 0) return 0;
+    rank = (size_t)(p * n);
+    if (rank >= n) rank = n - 1;
+    return v[rank];
+}
+
+int main(int argc, char **argv){
+    FILE *fp;
+    AccessLogHeader hdr;
+    AccessRecord rec;
+    uint32_t *samples[NPHASE], *total;
+    size_t nsamples[NPHASE] = {0}, cap = 1024, n = 0, hits = 0;
+    unsigned long long bytes = 0;
+    int i;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <accesslog>\n", argv[0]);
+        exit(1);
+    }
+    if ((fp = fopen(argv[1], "rb")) == NULL) {
+        perror(argv[1]);
+        exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 || hdr.magic != ACCESSLOG_MAGIC
+        || hdr.rec_size != sizeof(AccessRecord)) {
+        fprintf(stderr, "%s: not an access log (or version mismatch)\n", argv[1]);
+        exit(1);
+    }
+
+    for (i = 0; i < NPHASE; i++)
+        samples[i] = malloc(cap * sizeof(uint32_t));
+    total = malloc(cap * sizeof(uint32_t));
+
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        uint32_t sum = 0;
+        if (n == cap) {
+            cap *= 2;
+            for (i = 0; i < NPHASE; i++)
+                samples[i] = realloc(samples[i], cap * sizeof(uint32_t));
+            total = realloc(total, cap * sizeof(uint32_t));
+        }
+        //캐시 히트면 connect/ttfb를 안 거치므로 거친 단계만 샘플로 센다
+        for (i = 0; i < NPHASE; i++) {
+            sum += rec.phase_us[i];
+            if (rec.cache_hit && (i == PHASE_CONNECT || i == PHASE_TTFB))
+                continue;
+            samples[i][nsamples[i]++] = rec.phase_us[i];
+        }
+        total[n++] = sum;
+        hits += rec.cache_hit;
+        bytes += rec.bytes;
+    }
+    fclose(fp);
+
+    printf("requests: %zu  cache hits: %zu (%.1f%%)  bytes: %llu\n",
+           n, hits, n ? 100.0 * hits / n : 0.0, bytes);
+    printf("%-10s %8s %10s %10s %10s %10s %10s\n",
+           "phase(us)", "count", "p50", "p90", "p99", "p999", "max");
+    for (i = 0; i <= NPHASE; i++) {
+        uint32_t *v = (i < NPHASE) ? samples[i] : total;
+        size_t cnt = (i < NPHASE) ? nsamples[i] : n;
+        qsort(v, cnt, sizeof(uint32_t), cmp_u32);
+        printf("%-10s %8zu %10u %10u %10u %10u %10u\n",
+               i < NPHASE ? phase_names[i] : "total", cnt,
+               percentile(v, cnt, 0.50), percentile(v, cnt, 0.90),
+               percentile(v, cnt, 0.99), percentile(v, cnt, 0.999),
+               cnt ? v[cnt - 1] : 0);
+    }
+    return 0;
+}
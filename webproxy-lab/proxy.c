@@ -1,28 +1,93 @@
 #include <stdio.h>
 #include "csapp.h"
 #include "cache.h"
+#include "accesslog.h"
+#include "http.h"
+#include "refresh.h"
+#include "compress.h"
+#include "stats.h"
+#include "iouring.h"
+#include "coro.h"
+#include "admin.h"
+#include "config.h"
+#include "handoff.h"
 #include <time.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 clock_t start,end;
 double elapsed;
 
-/* Recommended max cache and object sizes */
-#define MAX_CACHE_SIZE 1049000
-#define MAX_OBJECT_SIZE 102400
-
 #if IS_LOCAL_TEST
 int is_local_test = 1;
 #else
 int is_local_test = 0;
 #endif
 
+/* -w 모드에서 자기 SO_REUSEPORT 리스너로 accept하는 워커 */
+typedef struct {
+  int id;
+  int listenfd;
+} acceptor_t;
+
+#define ACCEPT_BATCH 64 // 워커가 한 번 깨어날 때 최대로 받는 연결 수
+#define ACCEPT_BACKOFF_MS 50 // fd가 바닥났을 때(EMFILE/ENFILE) accept를 쉬는 시간
+#define VIA_NAME "webproxy" // 캐시에서 내보낸 응답의 Via에 붙이는 이름
+#define OBJECT_BUF_INITIAL (64 * 1024) // 미스 응답 버퍼의 처음 크기. 큰 응답이면 object_buf_size까지 두 배씩
+
+/* gzip으로 바꿔 보내는 중인 응답: 압축된 출력을 클라이언트로 보내면서 캐시용으로도 모음 */
+typedef struct {
+  int clientfd;
+  size_t sent;
+  GzipBuffer body;
+} gzip_relay_t;
+
+int nworkers = 0; // 0이면 main 혼자 accept (기존 방식)
+int ncoro = 0;    // >0이면 스레드 대신 코루틴: 이만큼의 스케줄러 스레드가 연결을 나눠 맡음
+int pin_cpus = 0; // 워커 i를 CPU i에 고정
+size_t object_buf_size = MAX_OBJECT_SIZE; // 응답을 모으는 요청별 버퍼 (시작할 때 max_object_size로 정함)
+
+ProxyConfig config;           // 지금 적용된 설정
+char *config_path;            // -f (없으면 NULL)
+char *overrides[CONFIG_MAX_OVERRIDES][2]; // 명령행에서 준 key/value. SIGHUP으로 다시 읽을 때도 이긴다
+int noverrides;
+
+int drain_fd;        // drain을 시작하면 읽을 수 있게 되는 eventfd. accept 루프마다 리스너와 같이 기다림
+int draining;        // (atomic)
+int active_conns;    // accept했지만 아직 안 끝난 연결 (atomic). drain은 이게 0이 되길 기다림
+char *takeover_path; // -x: 리스너를 넘겨받을 옛 프로세스의 관리 소켓
+int inherited[HANDOFF_MAX_FDS]; // 넘겨받은 듣기 소켓
+int ninherited, next_inherited;
+
 void *thread(void *vargp);
-void format_http_header(rio_t *client_rio, char *path, char *hostname, char *other_header);
+void *acceptor(void *vargp);
+void coro_acceptor(void *vargp);
+void coro_client(void *vargp);
+void accept_loop(int listenfd);
+void format_http_header(char *request_buf, char *path, char *hostname, char *other_header);
 void read_requesthdrs(rio_t *rp, char *host_header, char *other_header);
 void parse_uri(char *uri, char *hostname, char *port, char *path);
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
 void handle_client(int clientfd);
-void sigint_handler(int sig);
+void usage(char *prog);
+void add_conditional_headers(char *headers, size_t size, const CacheMeta *meta);
+void store_response(const CacheKey *key, const char *req_headers, char *data, int size, HttpResponse *resp);
+void store_not_modified(const CacheKey *key, const char *vary_key, HttpResponse *resp, const CacheMeta *old);
+void refresh_object(char *uri, char *vary_headers);
+void serve_cached(int clientfd, CacheObject *obj, const CacheMeta *meta, char *range, AccessRecord *rec);
+void gzip_relay_sink(void *arg, const char *buf, size_t len);
+int build_gzip_object(const char *hdrs, const HttpResponse *resp, const char *body, size_t blen, char *out);
+int gzip_object(char *obj, int size, HttpResponse *resp, char *out);
+char *grow_object_buf(char *buf, size_t *cap, size_t need);
+void cli_set(char *prog, char *key, char *value);
+void *signal_thread(void *vargp);
+void control_signals(sigset_t *set);
+void reload_config(void);
+void drain(sigset_t *set);
+int take_listener(char *port, int reuseport);
+int listen_waitfd(int listenfd);
 
 
 /* You won't lose style points for including this long line in your code */
@@ -41,41 +106,316 @@ int main(int argc, char **argv)
 {
   atexit(flush_gprof);
   start=clock();
-  int listenfd, connfd;
-  char hostname[MAXLINE], port[MAXLINE];
-  socklen_t clientlen;
-  struct sockaddr_storage clientaddr;
+  int listenfd;
+  int opt;
+  char *eq;
+  sigset_t sigs;
+  pthread_t tid;
 
   /* Check command line args */
-  if (argc != 2)
-  {
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
+  // 설정 파일을 먼저 읽어야 명령행 플래그가 그 위에 덮어쓸 수 있으므로 -f만 먼저 찾는다
+  config_defaults(&config);
+  while ((opt = getopt(argc, argv, "l:w:ao:r:z:e:c:s:f:D:x:")) != -1)
+    if (opt == 'f')
+      config_path = optarg;
+    else if (opt == '?')
+      usage(argv[0]);
+  if (config_path && config_load(&config, config_path) < 0)
     exit(1);
+
+  optind = 0; // glibc getopt를 처음부터 다시 초기화 (1이면 내부 상태가 남음)
+  while ((opt = getopt(argc, argv, "l:w:ao:r:z:e:c:s:f:D:x:")) != -1) {
+    switch (opt) {
+    case 'f':
+      break;
+    case 'x': // 무중단 교체: 옛 프로세스의 관리 소켓에서 듣기 소켓을 넘겨받음
+      takeover_path = optarg;
+      break;
+    case 'D': // 설정 파일의 어떤 key든: -D cache_size=64M
+      if ((eq = strchr(optarg, '=')) == NULL)
+        usage(argv[0]);
+      *eq = '\0';
+      cli_set(argv[0], optarg, eq + 1);
+      break;
+    case 'l': // 요청별 phase 타이밍을 바이너리 로그로 남김
+      cli_set(argv[0], "accesslog", optarg);
+      break;
+    case 'w': // 코어마다 SO_REUSEPORT 리스너 + accept 워커
+      cli_set(argv[0], "workers", optarg);
+      break;
+    case 'a':
+      cli_set(argv[0], "pin_cpus", "1");
+      break;
+    case 'c': // 코루틴 모드: epoll 스케줄러 스레드 수
+      cli_set(argv[0], "coroutines", optarg);
+      break;
+    case 's': // 관리 채널 유닉스 소켓 (캐시 목록/삭제/크기 변경)
+      cli_set(argv[0], "admin_socket", optarg);
+      break;
+    case 'r': // 백그라운드 갱신 워커 수 (0이면 끔)
+      cli_set(argv[0], "refresh_workers", optarg);
+      break;
+    case 'z': // gzip 압축 레벨 (0이면 압축 안 함)
+      cli_set(argv[0], "gzip_level", optarg);
+      break;
+    case 'e': // 응답 중계 I/O 엔진: sync(기본) 또는 uring
+      cli_set(argv[0], "engine", optarg);
+      break;
+    case 'o': // 소켓 튜닝: nodelay,defer=1,fastopen=256,sndbuf=N,rcvbuf=N,backlog=N
+      cli_set(argv[0], "sockopts", optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
+  if (config.sockopts[0] && parse_sockopts(config.sockopts) < 0)
+    usage(argv[0]);
+  nworkers = config.workers;
+  pin_cpus = config.pin_cpus;
+  ncoro = config.coroutines;
+  gzip_level = config.gzip_level;
+  http_default_ttl = config.default_ttl;
+  http_default_swr = config.default_swr;
+  refresh_min_hits = config.refresh_min_hits;
+  int engine = config.engine;
+
+  // SIGHUP/SIGINT/SIGTERM/SIGUSR1은 signal_thread만 sigwait로 받는다. 스레드를 만들기 전에 막아야 모두 물려받음
+  control_signals(&sigs);
+  pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+  if ((drain_fd = eventfd(0, EFD_CLOEXEC)) < 0)
+    unix_error("eventfd error");
+  Pthread_create(&tid, NULL, signal_thread, NULL);
+
+  // 관리 소켓 경로가 같을 수 있으므로 admin_start(unlink 후 bind)보다 먼저 받아 온다
+  if (takeover_path) {
+    int need = ncoro > 0 ? (ncoro < CORO_MAX_SCHEDS ? ncoro : CORO_MAX_SCHEDS) : nworkers > 0 ? nworkers : 1;
+    if ((ninherited = handoff_fetch(takeover_path, inherited, HANDOFF_MAX_FDS)) < 0) {
+      fprintf(stderr, "cannot take over listeners from %s\n", takeover_path);
+      exit(1);
+    }
+    fprintf(stderr, "took over %d listeners from %s\n", ninherited, takeover_path);
+    // 남는 리스너는 닫는다. 옛 프로세스가 나가면 그 accept 큐에 있던 연결은 끊기므로 -w/-c는 맞춰서
+    for (; ninherited > need; ninherited--) {
+      fprintf(stderr, "closing extra listener (start with the same -w/-c to keep it)\n");
+      Close(inherited[ninherited - 1]);
+    }
   }
 
-  listenfd = Open_listenfd(argv[1]); //듣기 소켓 오픈!
   init_cache();
-  signal(SIGINT, sigint_handler); // 시그널 핸들러는 가능한 빨리
-  while (1) //무한 서버 루프 실행 
-  {
-    int* connfd_p = Malloc(sizeof(int));
-    *connfd_p = Accept(listenfd, (SA *)&clientaddr, &clientlen);
-    pthread_t tid;
-    pthread_create(&tid, NULL, thread, connfd_p);
+  object_buf_size = config.max_object_size;
+  cache_set_limits(config.cache_size, config.max_object_size);
+  if (config.cache_snapshot[0]) {
+    // 교체 중이면 옛 프로세스가 지금 캐시를 먼저 써 준다
+    if (takeover_path && handoff_snapshot(config.cache_snapshot) < 0)
+      fprintf(stderr, "handoff: no cache snapshot from %s\n", takeover_path);
+    int n = cache_load_snapshot(config.cache_snapshot);
+    if (n >= 0)
+      fprintf(stderr, "cache: loaded %d entries from %s\n", n, config.cache_snapshot);
+    else if (errno != ENOENT)
+      fprintf(stderr, "cache: cannot load %s: %s\n", config.cache_snapshot, strerror(errno));
+  }
+  // 요청마다 object_buf_size짜리 버퍼에 모으므로 maxobject는 그 이상 올릴 수 없음
+  if (config.admin_socket[0] && admin_start(config.admin_socket, object_buf_size) < 0) {
+    fprintf(stderr, "cannot open admin socket %s: %s\n", config.admin_socket, strerror(errno));
+    exit(1);
+  }
+  if (ncoro > 0 && engine == IO_URING) {
+    // 링 완료를 기다리면 스케줄러 스레드 전체가 멈추므로 코루틴 모드는 rio + epoll로
+    fprintf(stderr, "-e uring is ignored with -c\n");
+    engine = IO_SYNC;
   }
+  io_init(engine); // 커널이 io_uring을 지원하지 않으면 sync로 떨어짐
+  init_refresh(config.refresh_workers, refresh_object);
+  if (config.accesslog[0] && init_accesslog(config.accesslog) < 0)
+    exit(1);
+
+  if (ncoro > 0) {
+    // 스케줄러마다 자기 SO_REUSEPORT 리스너를 갖고, 연결마다 코루틴 하나.
+    // handle_client는 그대로고 rio가 EAGAIN에서 막히는 대신 코루틴만 멈춘다.
+    // 새 연결은 받은 스케줄러의 덱에 쌓이고, 한가한 스케줄러가 훔쳐가 시작한다
+    sched_start(ncoro, coro_acceptor, argv[optind], coro_client);
+    if (takeover_path)
+      handoff_release(); // 넘겨받은 소켓은 이미 이 프로세스에 있으므로 스케줄러가 아직 안 떠도 됨
+    while (1)
+      pause();
+  }
+
+  if (nworkers > 0) {
+    // 워커마다 같은 포트에 리스너를 따로 열면 커널이 새 연결을 나눠준다.
+    // 하나의 accept 루프가 병목이 되지 않음
+    for (int i = 0; i < nworkers; i++) {
+      acceptor_t *a = Malloc(sizeof(acceptor_t));
+      pthread_t tid;
+      a->id = i;
+      a->listenfd = take_listener(argv[optind], 1);
+      Pthread_create(&tid, NULL, acceptor, a);
+    }
+    if (takeover_path)
+      handoff_release();
+    while (1)
+      pause();
+  }
+
+  listenfd = take_listener(argv[optind], 0); //듣기 소켓 오픈!
+  if (takeover_path)
+    handoff_release();
+  accept_loop(listenfd);
+  while (1) // drain 중: signal_thread가 끝낼 때까지
+    pause();
 }
 
+/*
+ * 듣기 소켓 하나. 옛 프로세스에서 넘겨받은 게 있으면 새로 bind하지 않고 그걸 쓴다
+ * (리스너가 더 필요하면 넘겨받은 소켓을 dup해서 나눠 씀: 새로 bind하면 옛 소켓과 충돌할 수 있음)
+ */
+int take_listener(char *port, int reuseport){
+  int fd;
+
+  if (ninherited > 0) {
+    int i = __atomic_fetch_add(&next_inherited, 1, __ATOMIC_RELAXED);
+    if (i < ninherited)
+      fd = inherited[i];
+    else if ((fd = fcntl(inherited[i % ninherited], F_DUPFD_CLOEXEC, 0)) < 0)
+      unix_error("dup error");
+  } else
+    fd = reuseport ? Open_reuseport_listenfd(port) : Open_listenfd(port);
+  handoff_add_listener(fd); // 다음 교체 때 넘겨줄 수 있게
+  return fd;
+}
+
+//리스너나 drain_fd가 준비되면 읽을 수 있게 되는 epoll. 코루틴도 fd 하나로 둘 다 기다릴 수 있음
+int listen_waitfd(int listenfd){
+  struct epoll_event ev;
+  int waitfd;
+
+  if ((waitfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    unix_error("epoll_create error");
+  ev.events = EPOLLIN;
+  ev.data.fd = listenfd;
+  if (epoll_ctl(waitfd, EPOLL_CTL_ADD, listenfd, &ev) < 0)
+    unix_error("epoll_ctl error");
+  ev.data.fd = drain_fd;
+  if (epoll_ctl(waitfd, EPOLL_CTL_ADD, drain_fd, &ev) < 0)
+    unix_error("epoll_ctl error");
+  return waitfd;
+}
+
+/*
+ * 서버 루프: 연결마다 스레드를 하나씩 띄운다. drain이 시작되면 리스너를 닫고 돌아감
+ * (넘겨준 뒤라면 새 프로세스의 사본이 있어 소켓은 계속 열려 있음)
+ */
+void accept_loop(int listenfd){
+  int fds[ACCEPT_BATCH];
+  struct pollfd pfd = { listen_waitfd(listenfd), POLLIN, 0 };
+
+  // 리스너를 non-blocking으로 두고, 깨어날 때마다 accept 큐를 EAGAIN까지 비운다.
+  // 넘겨받은 소켓이면 옛 프로세스와 플래그를 공유하므로 양쪽 모두 non-blocking이어야 함
+  fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+  while (1) {
+    if (poll(&pfd, 1, -1) < 0)
+      continue;
+    if (__atomic_load_n(&draining, __ATOMIC_SEQ_CST))
+      break;
+    int n = accept_batch(listenfd, fds, ACCEPT_BATCH);
+    // fd가 바닥나면 연결이 큐에 남아 리스너가 계속 readable이므로 poll이 바로 돌아온다.
+    // 잠깐 쉬어서 연결이 끝나며 fd가 풀리길 기다림 (안 그러면 CPU 하나를 태우며 돎)
+    if (n < 0 && (errno == EMFILE || errno == ENFILE))
+      poll(NULL, 0, ACCEPT_BACKOFF_MS);
+    for (int i = 0; i < n; i++) {
+      int *connfd_p = Malloc(sizeof(int));
+      pthread_t tid;
+      *connfd_p = fds[i];
+      __atomic_add_fetch(&active_conns, 1, __ATOMIC_SEQ_CST);
+      pthread_create(&tid, NULL, thread, connfd_p);
+    }
+  }
+  Close(pfd.fd);
+  Close(listenfd);
+}
 
+void *acceptor(void *vargp){
+  acceptor_t *a = vargp;
+
+  // 여기서 고정하면 이 워커가 만드는 연결 스레드들도 같은 CPU를 물려받음
+  if (pin_cpus)
+    pin_thread_to_cpu(a->id);
+  accept_loop(a->listenfd);
+  Free(a);
+  return NULL;
+}
+
+
+
+//코루틴 모드의 accept 루프 (스케줄러마다 하나). 기다릴 때는 이 코루틴만 멈춤
+void coro_acceptor(void *vargp){
+  int fds[ACCEPT_BATCH];
+  int listenfd = take_listener((char *)vargp, 1);
+  int waitfd = listen_waitfd(listenfd);
+  //EMFILE/ENFILE일 때 쉬는 타이머 (코루틴이라 스레드를 재울 수 없음). fd가 바닥난 뒤에는 못 만드니 미리
+  int backofffd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (pin_cpus)
+    pin_thread_to_cpu(coro_sched_id());
+  fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+  while (!__atomic_load_n(&draining, __ATOMIC_SEQ_CST)) {
+    int n = accept_batch(listenfd, fds, ACCEPT_BATCH);
+    if (n < 0 && (errno == EMFILE || errno == ENFILE)) {
+      // 리스너는 계속 readable이라 기다려도 바로 깨므로 타이머로 쉰다 (accept_loop와 같은 이유)
+      struct itimerspec its = { { 0, 0 }, { 0, ACCEPT_BACKOFF_MS * 1000000L } };
+      uint64_t expirations;
+      if (backofffd >= 0 && timerfd_settime(backofffd, 0, &its, NULL) == 0) {
+        rio_wait(backofffd, POLLIN);
+        if (read(backofffd, &expirations, sizeof(expirations)) < 0) {}
+      }
+      continue;
+    }
+    if (n <= 0) {
+      rio_wait(waitfd, POLLIN); //리스너 또는 drain
+      continue;
+    }
+    for (int i = 0; i < n; i++) {
+      fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+      __atomic_add_fetch(&active_conns, 1, __ATOMIC_SEQ_CST);
+      if (sched_submit((void *)(long)fds[i]) < 0
+          && coro_spawn(coro_client, (void *)(long)fds[i]) < 0) {
+        Close(fds[i]);
+        __atomic_sub_fetch(&active_conns, 1, __ATOMIC_SEQ_CST);
+      }
+    }
+  }
+  if (backofffd >= 0)
+    Close(backofffd);
+  Close(waitfd);
+  Close(listenfd);
+}
+
+void coro_client(void *vargp){
+  int connfd = (int)(long)vargp;
+  handle_client(connfd);
+  Close(connfd);
+  __atomic_sub_fetch(&active_conns, 1, __ATOMIC_SEQ_CST);
+}
 
 void handle_client(int clientfd){
   struct stat sbuf;
   char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
-  char host_header[MAXLINE], other_header[MAXLINE];
+  char host_header[MAXLINE], other_header[MAXLINE], range[MAXLINE];
   char hostname[MAXLINE], path[MAXLINE], port[MAXLINE];
   char request_buf[MAXLINE], response_buf[MAXLINE];
   rio_t client_rio, server_rio;
   int flag;
   int serverfd;
+  AccessRecord rec;
+  uint64_t t_phase, t_now;
+  CacheObject cobj; // 캐시에서 찾은 사본 (본문은 참조라 done에서 놓음)
+  char *data_buf = NULL, *gz_buf = NULL; // 미스일 때 응답을 모으는 버퍼 (object_buf_size)
+
+  // phase 타이밍 기록 시작
+  cobj.body = NULL;
+  memset(&rec, 0, sizeof(rec));
+  rec.start_ns = t_phase = now_ns();
 
   //1. 요청 라인 읽기
   Rio_readinitb(&client_rio, clientfd);
@@ -88,8 +428,8 @@ void handle_client(int clientfd){
   if(strcasecmp(method, "GET") != 0 && strcasecmp(method, "HEAD") != 0){ //strcasecmp는 두 함수가 동일하면 리턴 0, 다르면 1이다.
     clienterror(clientfd, method, "501", "Not implemented",
     "Tiny dose not implement this method");
-    close(clientfd);
-    return;
+    rec.status = 501;
+    goto done;
   }
 
   //2. URI 파싱
@@ -97,42 +437,397 @@ void handle_client(int clientfd){
 
   //3. 헤더 읽고
   read_requesthdrs(&client_rio, host_header, other_header); // read HTTP request headers
+  get_header(other_header, "Range", range, MAXLINE); // 캐시에서 잘라 줄 때 씀 (미스면 그대로 전달)
+  int accept_gzip = normalize_accept_encoding(other_header, sizeof(other_header)); // Vary 변형이 gzip/identity 둘로만 나뉘게
   // HTTP 1.1->HTTP 1.0으로 변경
   format_http_header(request_buf, path, hostname, other_header);
+  t_now = now_ns();
+  rec.phase_us[PHASE_PARSE] = elapsed_us(t_phase, t_now);
+  t_phase = t_now;
 
-  // NEW! : 캐시 조회
-  char cache_buf[MAX_OBJECT_SIZE];
-  int cache_size;
-  if (find_cache(uri, cache_buf, &cache_size)) {
-    Rio_writen(clientfd, cache_buf, cache_size);
-    Close(clientfd);
-    return;
+  // NEW! : 캐시 조회 (정규화된 키와 해시는 여기서 한 번만 만들고 저장할 때도 씀)
+  char vary_key[MAXLINE]; // 찾은 변형을 고른 요청 헤더들
+  CacheMeta meta;
+  CacheKey key;
+  make_cache_key(&key, uri);
+  int hit = find_cache(&key, other_header, &cobj, &meta);
+  if (hit != CACHE_MISS)
+    select_vary_headers(meta.vary, other_header, vary_key, MAXLINE);
+  t_now = now_ns();
+  rec.phase_us[PHASE_LOOKUP] = elapsed_us(t_phase, t_now);
+  t_phase = t_now;
+  if (hit == CACHE_HIT || hit == CACHE_REFRESH) {
+    // 곧 만료될 인기 오브젝트는 지금 사본을 내보내고 갱신은 백그라운드 워커에게
+    if (hit == CACHE_REFRESH)
+      schedule_refresh(key.uri, vary_key);
+    serve_cached(clientfd, &cobj, &meta, range, &rec);
+    rec.phase_us[PHASE_TRANSFER] = elapsed_us(t_phase, now_ns());
+    goto done; // clientfd는 thread()에서 닫음
   }
 
 
+  // stale이지만 validator가 있으면 조건부 요청으로 재검증한다.
+  // 서버가 304를 주면 본문은 다시 받지 않고 캐시된 걸 내보냄
+  if (hit == CACHE_STALE) {
+    // 재검증 결과가 200이면 그걸로 캐시를 교체해야 하니 원 서버에는 전체를 달라고 한다
+    remove_header(other_header, "Range");
+    add_conditional_headers(other_header, sizeof(other_header), &meta);
+    format_http_header(request_buf, path, hostname, other_header);
+  }
+
   //4. 서버 연결
-  serverfd = Open_clientfd(hostname, port);
-  if(serverfd<0) return;
+  serverfd = open_clientfd(hostname, port); // 실패해도 프록시 전체가 죽지 않도록 소문자 버전
+  t_now = now_ns();
+  rec.phase_us[PHASE_CONNECT] = elapsed_us(t_phase, t_now);
+  t_phase = t_now;
+  if(serverfd<0) {
+    if (hit == CACHE_STALE) {
+      // 원 서버에 연결이 안 되면 재검증 못 한 stale 사본이라도 내보낸다 (stale-if-error)
+      serve_cached(clientfd, &cobj, &meta, range, &rec);
+      goto done;
+    }
+    clienterror(clientfd, hostname, "502", "Bad Gateway",
+    "Proxy couldn't connect to the server");
+    rec.status = 502;
+    goto done;
+  }
 
   //5. 서버로 요청 전송
   Rio_writen(serverfd, request_buf, strlen(request_buf));
 
   //6. 응답 수신+ 클라이언트 전달 + 캐시 누적
-  char data_buf[MAX_OBJECT_SIZE];
+  // 원본(data_buf)과 압축해서 보낸 본문(gz_buf). max_object_size가 클 수 있으므로 미스마다
+  // 최대 크기를 잡지 않는다: data_buf는 받는 만큼 늘리고, gz_buf는 압축할 때만 잡음
+  char gz_hdr[MAXBUF]; // gzip용으로 고친 헤더
+  size_t data_cap = 0;
   int total_size = 0;
   ssize_t n;
+  HttpResponse resp;
+  int hdr_state = 0;  // 0: 헤더 아직 덜 옴, 1: 파싱 완료, -1: 응답이 이상함
+  int cacheable = 1;  // 헤더를 보고 저장해도 되는 응답인지
+  int raw_fits = 1;   // 원본 응답이 data_buf에 다 들어있는지
+  int gzipping = 0, gz_hlen = 0;
+  GzipStream gz;
+  gzip_relay_t relay = { clientfd, 0, { NULL, 0, object_buf_size, 0 } };
+  IoRelay io;
+  char *chunk;
   Rio_readinitb(&server_rio, serverfd);
 
-  while ((n = Rio_readnb(&server_rio, response_buf, MAXBUF)) > 0) {
-    if (total_size + n <= MAX_OBJECT_SIZE)
-      memcpy(data_buf + total_size, response_buf, n);
-      total_size += n;
-      Rio_writen(clientfd, response_buf, n);
+  // Rio_readnb는 MAXBUF가 다 찰 때까지 기다리므로 첫 바이트 도착은 따로 잰다 (TTFB)
+  rio_wait(serverfd, POLLIN);
+  t_now = now_ns();
+  rec.phase_us[PHASE_TTFB] = elapsed_us(t_phase, t_now);
+  t_phase = t_now;
+
+  // -e uring이면 클라이언트로 보내기와 다음 덩어리 받기를 한 번의 syscall로 같이 넘긴다
+  io_relay_begin(&io, &server_rio, response_buf, serverfd, clientfd);
+  while ((n = io_relay_read(&io, &chunk)) > 0) {
+    if (total_size == 0)
+      sscanf(chunk, "HTTP/%*s %hu", &rec.status);
+    if (raw_fits && total_size + n <= object_buf_size) {
+      if (total_size + n > data_cap)
+        data_buf = grow_object_buf(data_buf, &data_cap, total_size + n);
+      memcpy(data_buf + total_size, chunk, n);
+    } else
+      raw_fits = 0; // 너무 큰 오브젝트는 (압축해서 줄지 않는 한) 전달만 하고 저장 안 함
+    total_size += n;
+
+    // 헤더가 다 모이면 한 번만 파싱해서 캐시할지 정한다
+    if (hdr_state == 0 && raw_fits) {
+      hdr_state = parse_response_headers(data_buf, total_size, &resp);
+      if (hdr_state == 1 && hit == CACHE_STALE && resp.status == 304)
+        break; // 재검증 성공. 304는 클라이언트가 보낸 요청의 답이 아니므로 전달하지 않음
+      if (hdr_state == 1) {
+        cacheable = response_cacheable(&resp);
+        // 헤더가 첫 덩어리에 다 들어왔고 압축할 만한 응답이면 여기서부터 gzip으로 바꿔
+        // 보낸다. 본문은 받는 덩어리마다 압축해서 바로 내보냄
+        if (accept_gzip && total_size == n && gzip_applicable(&resp)
+            && (gz_hlen = gzip_rewrite_headers(data_buf, &resp, -1, gz_hdr, MAXBUF)) > 0
+            && gzip_begin(&gz, gzip_relay_sink, &relay) == 0) {
+          gzipping = 1;
+          relay.body.buf = gz_buf = Malloc(object_buf_size);
+          Rio_writen(clientfd, gz_hdr, gz_hlen);
+          gzip_feed(&gz, chunk + resp.header_len, n - resp.header_len);
+          continue;
+        }
+      }
+      else if (hdr_state < 0)
+        cacheable = 0;
     }
+    if (gzipping)
+      gzip_feed(&gz, chunk, n);
+    else if (io_relay_write(&io, chunk, n) < 0)
+      break; // 클라이언트가 끊김 (uring만: sync는 Rio_writen이 처리)
+  }
+  io_relay_end(&io); // 남은 send를 다 보낸 뒤에야 클라이언트에 다른 걸 쓸 수 있음
+  if (gzipping)
+    gzip_end(&gz);
   Close(serverfd);
 
-  //캐시 저장
-  write_cache(uri, data_buf, total_size );
+  if (hit == CACHE_STALE && hdr_state == 1 && resp.status == 304) {
+    store_not_modified(&key, vary_key, &resp, &meta);
+    serve_cached(clientfd, &cobj, &meta, range, &rec);
+    rec.phase_us[PHASE_TRANSFER] = elapsed_us(t_phase, now_ns());
+    goto done;
+  }
+  rec.bytes = gzipping ? gz_hlen + relay.sent : total_size;
+  rec.phase_us[PHASE_TRANSFER] = elapsed_us(t_phase, now_ns());
+
+  //캐시 저장: 헤더까지 정상적으로 받았고 저장해도 되는 응답만.
+  //압축해서 보냈으면 원본 대신 (더 작은) gzip 변형을 Content-Length와 함께 저장
+  if (gzipping) {
+    // 헤더(MAXBUF 미만)와 압축 본문이 들어갈 만큼 data_buf를 늘려서 그 자리에 만든다
+    if (cacheable && !relay.body.overflow)
+      data_buf = grow_object_buf(data_buf, &data_cap,
+                                 relay.body.len + MAXBUF < object_buf_size ? relay.body.len + MAXBUF : object_buf_size);
+    if (cacheable && !relay.body.overflow
+        && (total_size = build_gzip_object(data_buf, &resp, gz_buf, relay.body.len, data_buf)) > 0)
+      store_response(&key, other_header, data_buf, total_size, &resp);
+  }
+  else if (cacheable && raw_fits && hdr_state == 1)
+    store_response(&key, other_header, data_buf, total_size, &resp);
+  // Range 미스는 206을 그대로 전달했으니 캐시할 수 있는 크기면 전체를 백그라운드로 받아둔다.
+  // 그 뒤의 구간 요청(동영상 탐색 등)은 캐시에서 잘라서 준다
+  else if (hdr_state == 1 && resp.status == 206 && resp.range_total >= 0
+           && resp.header_len + resp.range_total <= object_buf_size) {
+    select_vary_headers(resp.vary, other_header, vary_key, MAXLINE);
+    schedule_refresh(key.uri, vary_key);
+  }
+
+done:
+  release_cache_body(cobj.body);
+  free(data_buf);
+  free(gz_buf);
+  STAT_ADD(requests, 1);
+  if (rec.cache_hit)
+    STAT_ADD(cache_hits, 1);
+  accesslog_push(&rec);
+}
+
+//압축된 출력을 클라이언트에게 보내면서 캐시에 넣을 본문으로도 모은다
+void gzip_relay_sink(void *arg, const char *buf, size_t len){
+  gzip_relay_t *r = arg;
+
+  Rio_writen(r->clientfd, (char *)buf, len);
+  r->sent += len;
+  gzip_buffer_sink(&r->body, buf, len);
+}
+
+/*
+ * 압축된 본문 body 앞에 gzip용으로 고친 헤더(hdrs는 원래 응답 헤더)를 붙여
+ * 캐시에 넣을 응답을 out에 만든다. out은 hdrs와 같은 버퍼여도 된다.
+ * 길이를 돌려주고, 오브젝트 크기 제한을 넘으면 -1.
+ */
+int build_gzip_object(const char *hdrs, const HttpResponse *resp, const char *body, size_t blen, char *out){
+  char hdr[MAXBUF];
+  int hlen = gzip_rewrite_headers(hdrs, resp, blen, hdr, MAXBUF);
+
+  if (hlen < 0 || hlen + blen > object_buf_size)
+    return -1;
+  memcpy(out, hdr, hlen);
+  memcpy(out + hlen, body, blen);
+  return hlen + blen;
+}
+
+//미스 응답 버퍼를 need 바이트 이상으로 늘린다 (두 배씩, object_buf_size까지). 내용은 유지
+char *grow_object_buf(char *buf, size_t *cap, size_t need){
+  size_t c = *cap ? *cap : OBJECT_BUF_INITIAL;
+
+  while (c < need)
+    c *= 2;
+  if (c > object_buf_size)
+    c = object_buf_size;
+  *cap = c;
+  return Realloc(buf, c);
+}
+
+//원 서버의 전체 응답 obj를 통째로 압축해서 gzip 변형을 out에 만든다 (백그라운드 갱신용)
+int gzip_object(char *obj, int size, HttpResponse *resp, char *out){
+  char *body = Malloc(object_buf_size);
+  GzipBuffer b = { body, 0, object_buf_size, 0 };
+  GzipStream gz;
+  int len = -1;
+
+  if (gzip_begin(&gz, gzip_buffer_sink, &b) == 0) {
+    gzip_feed(&gz, obj + resp->header_len, size - resp->header_len);
+    gzip_end(&gz);
+    if (!b.overflow)
+      len = build_gzip_object(obj, resp, body, b.len, out);
+  }
+  Free(body);
+  return len;
+}
+
+/*
+ * 캐시된 응답 obj를 클라이언트에게 보낸다. 헤더는 이번 응답용으로 새로 쓰고
+ * (Age, Via, Connection) 공유하는 본문과 같이 writev 한 번으로 내보낸다.
+ * 클라이언트가 Range를 보냈고 캐시된 게 200이면 본문에서 그 구간만 잘라 206으로
+ * 보내고, 구간이 본문 밖이면 416을 보낸다.
+ */
+void serve_cached(int clientfd, CacheObject *obj, const CacheMeta *meta, char *range, AccessRecord *rec){
+  char hdr[MAXBUF + MAXLINE], via[MAXLINE], proto[8], *line, *next, *end;
+  char *body = obj->body->data;
+  long first = 0, last = (long)obj->body->len - 1, blen = obj->body->len, age = 0;
+  int rc = 0, n, status = 0;
+  struct iovec iov[2];
+
+  // 저장할 때 파싱해 둔 헤더라 히트마다는 상태 코드와 Age만 다시 본다 (날짜 파싱은 비쌈)
+  rec->cache_hit = 1;
+  obj->hdr[obj->hdr_len] = '\0';
+  if (sscanf(obj->hdr, "HTTP/%7s %d", proto, &status) != 2)
+    strcpy(proto, "1.0");
+  if (range[0] && status == 200)
+    rc = parse_byte_range(range, blen, &first, &last);
+  if (rc < 0) {
+    n = sprintf(hdr, "HTTP/1.0 416 Range Not Satisfiable\r\n"
+                "Content-Range: bytes */%ld\r\nContent-Length: 0\r\n\r\n", blen);
+    Rio_writen(clientfd, hdr, n);
+    rec->bytes = n;
+    rec->status = 416;
+    return;
+  }
+
+  // 홉마다 바뀌는 헤더는 빼고 다시 쓴다. 206이면 상태 줄과 길이 관련 헤더도 새로
+  if (rc > 0)
+    n = sprintf(hdr, "HTTP/1.0 206 Partial Content\r\n");
+  else {
+    n = strstr(obj->hdr, "\r\n") + 2 - obj->hdr;
+    memcpy(hdr, obj->hdr, n);
+  }
+  via[0] = '\0';
+  end = obj->hdr + obj->hdr_len - 2; // 마지막 빈 줄 앞
+  for (line = strstr(obj->hdr, "\r\n") + 2; line < end; line = next) {
+    next = strstr(line, "\r\n") + 2;
+    if (!strncasecmp(line, "Via:", 4) && next - line - 2 < MAXLINE - 64) {
+      memcpy(via, line + 4, next - line - 6); // 앞 사람들의 Via는 뒤에 이어 붙임
+      via[next - line - 6] = '\0';
+      continue;
+    }
+    if (!strncasecmp(line, "Age:", 4))
+      age = atol(line + 4);
+    if (!strncasecmp(line, "Age:", 4) || !strncasecmp(line, "Connection:", 11)
+        || !strncasecmp(line, "Proxy-Connection:", 17) || !strncasecmp(line, "Keep-Alive:", 11)
+        || (rc > 0 && (!strncasecmp(line, "Content-Length:", 15) || !strncasecmp(line, "Content-Range:", 14))))
+      continue;
+    memcpy(hdr + n, line, next - line);
+    n += next - line;
+  }
+  n += sprintf(hdr + n, "Age: %ld\r\nVia:%s%s %s " VIA_NAME "\r\nConnection: close\r\n",
+               age + (long)(time(NULL) - meta->fetched), via, via[0] ? "," : "", proto);
+  if (rc > 0)
+    n += sprintf(hdr + n, "Content-Range: bytes %ld-%ld/%ld\r\nContent-Length: %ld\r\n",
+                 first, last, blen, last - first + 1);
+  n += sprintf(hdr + n, "\r\n");
+
+  iov[0].iov_base = hdr;
+  iov[0].iov_len = n;
+  iov[1].iov_base = body + first;
+  iov[1].iov_len = blen ? last - first + 1 : 0;
+  rec->bytes = n + iov[1].iov_len;
+  rec->status = rc > 0 ? 206 : status;
+  Rio_writev(clientfd, iov, 2);
+}
+
+//stale 사본의 validator로 조건부 요청 헤더를 덧붙인다 (headers는 size 바이트 버퍼, 넘치는 줄은 안 붙임)
+void add_conditional_headers(char *headers, size_t size, const CacheMeta *meta){
+  char date[64];
+  size_t n = strlen(headers);
+  int len;
+
+  if (meta->etag[0]) {
+    len = snprintf(headers + n, size - n, "If-None-Match: %s\r\n", meta->etag);
+    if (len < 0 || (size_t)len >= size - n)
+      headers[n] = '\0'; //잘린 헤더를 보내지 않게
+    else
+      n += len;
+  }
+  if (meta->last_modified) {
+    format_http_date(meta->last_modified, date, sizeof(date));
+    len = snprintf(headers + n, size - n, "If-Modified-Since: %s\r\n", date);
+    if (len < 0 || (size_t)len >= size - n)
+      headers[n] = '\0';
+  }
+}
+
+//캐시해도 되는 전체 응답을 신선도/validator와 함께 저장.
+//응답이 Vary를 주면 그 헤더들의 요청 값(req_headers에서 고름)으로 변형을 구분
+void store_response(const CacheKey *key, const char *req_headers, char *data, int size, HttpResponse *resp){
+  time_t now = time(NULL);
+  char vary_key[MAXLINE];
+  CacheMeta meta;
+
+  meta.expires = response_expires_at(resp, now);
+  meta.last_modified = resp->last_modified;
+  strcpy(meta.etag, resp->etag);
+  meta.fetched = now;
+  meta.swr = resp->swr || resp->no_cache ? resp->swr : http_default_swr;
+  strcpy(meta.vary, resp->vary);
+  // 프록시가 gzip 변형을 따로 만드는 응답이면 identity 사본도 Accept-Encoding으로 구분해야
+  // gzip을 받는 클라이언트가 압축 안 된 사본에 걸리지 않는다
+  if (gzip_applicable(resp) && !strstr(meta.vary, "accept-encoding,"))
+    strcat(meta.vary, "accept-encoding,");
+  select_vary_headers(meta.vary, req_headers, vary_key, MAXLINE);
+  // 이미 stale이어도 validator가 있으면 나중에 재검증할 수 있으니 저장
+  if (meta.expires > now || meta.last_modified || meta.etag[0])
+    write_cache(key, vary_key, data, size, &meta);
+}
+
+//304 Not Modified: 본문은 그대로 두고 신선도만 갱신
+void store_not_modified(const CacheKey *key, const char *vary_key, HttpResponse *resp, const CacheMeta *old){
+  // 304에 새 Cache-Control/Expires가 있으면 그걸로, 없으면 저장된 Last-Modified로 신선도 계산
+  if (!resp->last_modified)
+    resp->last_modified = old->last_modified;
+  revalidate_cache(key, vary_key, response_expires_at(resp, time(NULL)));
+}
+
+/*
+ * 백그라운드 갱신 워커가 부르는 함수. 클라이언트 없이 원 서버에서
+ * uri를 다시 받아서 (validator가 있으면 조건부로) 캐시를 갱신한다.
+ * vary_headers는 갱신할 변형을 고른 요청 헤더로, 그대로 다시 보낸다.
+ */
+void refresh_object(char *uri, char *vary_headers){
+  char hostname[MAXLINE], port[MAXLINE], path[MAXLINE];
+  char headers[MAXLINE], request_buf[MAXLINE];
+  char *data_buf;
+  int serverfd, total_size = 0;
+  ssize_t n;
+  CacheMeta meta;
+  CacheKey key;
+  HttpResponse resp;
+
+  make_cache_key(&key, uri);
+  strcpy(headers, vary_headers);
+  if (peek_cache_meta(&key, vary_headers, &meta))
+    add_conditional_headers(headers, sizeof(headers), &meta);
+  parse_uri(uri, hostname, port, path);
+  format_http_header(request_buf, path, hostname, headers);
+
+  if ((serverfd = open_clientfd(hostname, port)) < 0)
+    return; // 다음 요청 때 다시 시도됨
+  data_buf = Malloc(object_buf_size);
+  if (rio_writen(serverfd, request_buf, strlen(request_buf)) < 0)
+    goto out;
+  // 캐시할 수 있는 크기까지만 받는다 (넘으면 어차피 저장 못 함)
+  while (total_size < object_buf_size
+         && (n = rio_readn(serverfd, data_buf + total_size, object_buf_size - total_size)) > 0)
+    total_size += n;
+  if (total_size == object_buf_size && rio_readn(serverfd, request_buf, 1) > 0)
+    goto out;
+
+  if (parse_response_headers(data_buf, total_size, &resp) == 1) {
+    if (resp.status == 304)
+      store_not_modified(&key, vary_headers, &resp, &meta);
+    else if (response_cacheable(&resp)) {
+      // gzip 변형을 갱신하는 거면 받은 원본을 다시 압축해서 넣는다
+      if (strstr(vary_headers, "accept-encoding: gzip") && gzip_applicable(&resp)
+          && (total_size = gzip_object(data_buf, total_size, &resp, data_buf)) < 0)
+        goto out;
+      store_response(&key, vary_headers, data_buf, total_size, &resp);
+    }
+  }
+out:
+  Close(serverfd);
+  Free(data_buf);
 }
 
 void read_requesthdrs(rio_t *rp, char *host_header, char *other_header){
@@ -147,12 +842,15 @@ void read_requesthdrs(rio_t *rp, char *host_header, char *other_header){
       //Host만 따로 저장해주면 되서? 
       strcpy(host_header, buf);
     }
-    else if(!strncasecmp(buf, "User-Agent:", 11)||!strncasecmp(buf, "Connection:", 11)||!strncasecmp(buf, "Proxy-Connection:", 17)){
-      //얘들은 버림
+    else if(!strncasecmp(buf, "User-Agent:", 11)||!strncasecmp(buf, "Connection:", 11)||!strncasecmp(buf, "Proxy-Connection:", 17)
+            ||!strncasecmp(buf, "If-Modified-Since:", 18)||!strncasecmp(buf, "If-None-Match:", 14)){
+      //얘들은 버림 (조건부 요청은 캐시 재검증할 때 프록시가 직접 붙임)
       continue;;
     }else{
-      //그 외의 헤더는 다른곳에 저장해둠 
-      strcat(other_header, buf);
+      //그 외의 헤더는 다른곳에 저장해둠 (MAXLINE을 넘기는 헤더는 버림)
+      size_t used = strlen(other_header), len = strlen(buf);
+      if (used + len < MAXLINE)
+        memcpy(other_header + used, buf, len + 1);
     }
   }
 }
@@ -202,9 +900,9 @@ void parse_uri(char *uri, char *hostname, char *port, char *path) {
     strcpy(port, "80");
   }
 }
-//format_http_header(&client_rio, path, host_header, other_header)
-void format_http_header(rio_t *client_rio, char *path, char *hostname, char *other_header){
-  sprintf( client_rio,
+//format_http_header(request_buf, path, hostname, other_header)
+void format_http_header(char *request_buf, char *path, char *hostname, char *other_header){
+  sprintf( request_buf,
   "GET %s HTTP/1.0\r\n"
   "Host: %s\r\n"
   "%s"
@@ -242,14 +940,145 @@ void *thread(void *vargp){
   pthread_detach(pthread_self()); // join 필요 없음
   handle_client(connfd);
   Close(connfd);
+  __atomic_sub_fetch(&active_conns, 1, __ATOMIC_SEQ_CST);
   return NULL;
 }
 
-void sigint_handler(int sig) {
-  deinit_cache();
+void usage(char *prog) {
+  fprintf(stderr, "usage: %s [-f config] [-D key=value] [-l accesslog] [-w workers [-a]] [-o sockopts] [-r refreshers] [-z gziplevel] [-e sync|uring] [-c coroutine-threads] [-s adminsock] [-x old-adminsock] <port>\n", prog);
+  exit(1);
+}
+
+//명령행 설정을 적용하고 기억해 둔다 (SIGHUP으로 파일을 다시 읽어도 명령행이 이김)
+void cli_set(char *prog, char *key, char *value){
+  if (config_set(&config, key, value) < 0) {
+    fprintf(stderr, "bad setting %s = %s\n", key, value);
+    usage(prog);
+  }
+  if (noverrides < CONFIG_MAX_OVERRIDES) {
+    overrides[noverrides][0] = key;
+    overrides[noverrides][1] = value;
+    noverrides++;
+  }
+}
+
+//signal_thread가 sigwait로 받는 시그널들
+void control_signals(sigset_t *set){
+  sigemptyset(set);
+  sigaddset(set, SIGHUP);
+  sigaddset(set, SIGINT);
+  sigaddset(set, SIGTERM);
+  sigaddset(set, SIGUSR1); // kill -USR1 <pid>: 통계 출력
+}
+
+/*
+ * 시그널은 핸들러 대신 이 스레드가 받는다. 보통 스레드라서 락을 잡는 정리 코드도
+ * 안전하게 부를 수 있음 (핸들러 안에서 deinit_cache를 부르면 락을 쥔 스레드와 엉킨다)
+ */
+void *signal_thread(void *vargp){
+  sigset_t set;
+  int sig;
+
+  pthread_detach(pthread_self());
+  control_signals(&set);
+  while (sigwait(&set, &sig) == 0) {
+    if (sig == SIGHUP)
+      reload_config();
+    else if (sig == SIGUSR1)
+      dump_stats(STDERR_FILENO);
+    else
+      drain(&set);
+  }
+  return NULL;
+}
+
+/*
+ * SIGHUP: 설정 파일을 다시 읽어 바로 바꿀 수 있는 것만 적용한다.
+ * 파일에 잘못된 줄이 있으면 아무것도 바꾸지 않음
+ */
+void reload_config(void){
+  ProxyConfig next;
+
+  config_defaults(&next);
+  if (config_path && config_load(&next, config_path) < 0) {
+    fprintf(stderr, "config reload failed, keeping the current settings\n");
+    return;
+  }
+  for (int i = 0; i < noverrides; i++)
+    config_set(&next, overrides[i][0], overrides[i][1]);
+
+  // 요청별 버퍼는 이미 잡은 크기라 최대 오브젝트는 그 아래로만 바꿀 수 있음
+  if (next.max_object_size > object_buf_size) {
+    fprintf(stderr, "config: max_object_size above %zu needs a restart\n", object_buf_size);
+    next.max_object_size = object_buf_size;
+  }
+  if (next.workers != config.workers || next.pin_cpus != config.pin_cpus
+      || next.coroutines != config.coroutines || next.engine != config.engine
+      || next.refresh_workers != config.refresh_workers || strcmp(next.sockopts, config.sockopts)
+      || strcmp(next.accesslog, config.accesslog) || strcmp(next.admin_socket, config.admin_socket)
+      || strcmp(next.cache_snapshot, config.cache_snapshot))
+    fprintf(stderr, "config: thread, engine, socket and log settings need a restart\n");
+  cache_set_limits(next.cache_size, next.max_object_size);
+  gzip_level = next.gzip_level;
+  // 캐시 정책은 다음에 받는/조회하는 응답부터 적용 (이미 저장된 엔트리의 만료 시각은 그대로)
+  http_default_ttl = next.default_ttl;
+  http_default_swr = next.default_swr;
+  refresh_min_hits = next.refresh_min_hits;
+  config.default_ttl = next.default_ttl;
+  config.default_swr = next.default_swr;
+  config.refresh_min_hits = next.refresh_min_hits;
+  config.cache_size = next.cache_size;
+  config.max_object_size = next.max_object_size;
+  config.gzip_level = next.gzip_level;
+  config.drain_timeout = next.drain_timeout;
+  fprintf(stderr, "config reloaded: cache_size %zu  max_object_size %zu  gzip_level %d"
+          "  default_ttl %d  stale_while_revalidate %d  refresh_min_hits %d\n",
+          config.cache_size, config.max_object_size, config.gzip_level,
+          config.default_ttl, config.default_swr, config.refresh_min_hits);
+}
+
+/*
+ * 그레이스풀 종료 (SIGINT, SIGTERM, 관리 채널 drain). 새 연결을 그만 받고, 이미 받은
+ * 연결이 끝나길 drain_timeout초까지 기다린 뒤 나간다. 기다리는 중 한 번 더 받으면 바로 나감
+ */
+void drain(sigset_t *set){
+  struct timespec tick = { 0, 50 * 1000 * 1000 };
+  time_t deadline = time(NULL) + config.drain_timeout;
+  uint64_t one = 1;
+  int left;
+
+  handoff_close(); // 넘겨주는 중이면 끝날 때까지 기다림
+  __atomic_store_n(&draining, 1, __ATOMIC_SEQ_CST);
+  if (write(drain_fd, &one, sizeof(one)) < 0) {} // accept 루프들을 깨운다
+  left = __atomic_load_n(&active_conns, __ATOMIC_SEQ_CST);
+  fprintf(stderr, "drain: %d connections in flight, waiting up to %ds\n", left, config.drain_timeout);
+  while (left > 0 && time(NULL) < deadline) {
+    int sig = sigtimedwait(set, NULL, &tick);
+    if (sig == SIGINT || sig == SIGTERM)
+      break;
+    if (sig == SIGUSR1)
+      dump_stats(STDERR_FILENO);
+    left = __atomic_load_n(&active_conns, __ATOMIC_SEQ_CST);
+  }
+  if (left > 0)
+    fprintf(stderr, "drain: giving up on %d connections\n", left);
+
+  dump_stats(STDERR_FILENO);
+  deinit_accesslog();
+  // 다음에 시작할 때 읽을 스냅샷 (남은 연결이 있어도 캐시 락을 잡으므로 안전)
+  if (config.cache_snapshot[0]) {
+    int n = cache_save_snapshot(config.cache_snapshot);
+    if (n >= 0)
+      fprintf(stderr, "cache: saved %d entries to %s\n", n, config.cache_snapshot);
+    else
+      fprintf(stderr, "cache: cannot write %s: %s\n", config.cache_snapshot, strerror(errno));
+  }
+  if (left == 0) // 남은 연결이 캐시를 읽고 있을 수 있으면 그냥 두고 나감
+    deinit_cache();
   end = clock();
   elapsed = (double)(end - start) / CLOCKS_PER_SEC;
   printf("전체 실행 시간: %f 초\n", elapsed);
-  fflush(stdout);  // <- 추가!
+  fflush(stdout);
   exit(0);
-}
\ No newline at end of file
+}
+
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "refresh.h"
+
+
+static RefreshQueue refresh_queue;
+
+static int same_job(const RefreshJob *job, char *uri, char *headers){
+    return job->uri && !strcmp(job->uri, uri) && !strcmp(job->headers, headers);
+}
+
+//큐에 있거나 누가 갱신 중인 작업인지 (락 잡은 상태에서 호출)
+static int pending_locked(char *uri, char *headers){
+    for (unsigned i = refresh_queue.tail; i != refresh_queue.head; i++)
+        if (same_job(&refresh_queue.jobs[i % REFRESH_QUEUE], uri, headers))
+            return 1;
+    for (int i = 0; i < refresh_queue.nworkers; i++)
+        if (same_job(&refresh_queue.inflight[i], uri, headers))
+            return 1;
+    return 0;
+}
+
+static void *refresh_worker(void *vargp){
+    int id = (int)(long)vargp;
+
+    pthread_detach(pthread_self());
+    pthread_mutex_lock(&refresh_queue.lock);
+    while (1) {
+        while (refresh_queue.head == refresh_queue.tail)
+            pthread_cond_wait(&refresh_queue.cond, &refresh_queue.lock);
+
+        RefreshJob job = refresh_queue.jobs[refresh_queue.tail % REFRESH_QUEUE];
+        refresh_queue.tail++;
+        refresh_queue.inflight[id] = job;
+        pthread_mutex_unlock(&refresh_queue.lock);
+
+        refresh_queue.refresh_fn(job.uri, job.headers); // 원 서버 왕복은 락 밖에서
+
+        pthread_mutex_lock(&refresh_queue.lock);
+        refresh_queue.inflight[id].uri = NULL;
+        refresh_queue.done++;
+        free(job.uri);
+        free(job.headers);
+    }
+    return NULL;
+}
+
+void init_refresh(int nworkers, void (*refresh_fn)(char *uri, char *headers)){
+    if (nworkers > REFRESH_MAX_WORKERS)
+        nworkers = REFRESH_MAX_WORKERS;
+    memset(&refresh_queue, 0, sizeof(refresh_queue));
+    refresh_queue.nworkers = nworkers;
+    refresh_queue.refresh_fn = refresh_fn;
+    pthread_mutex_init(&refresh_queue.lock, NULL);
+    pthread_cond_init(&refresh_queue.cond, NULL);
+
+    for (long i = 0; i < nworkers; i++) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, refresh_worker, (void *)i);
+    }
+}
+
+/*
+ * uri 갱신을 예약한다. headers는 원 서버 요청에 다시 붙일 (Vary) 헤더.
+ * 요청 경로에서 부르므로 절대 기다리지 않는다:
+ * 이미 예약/진행 중이거나 큐가 꽉 찼으면 -1을 돌려주고 끝.
+ */
+int schedule_refresh(char *uri, char *headers){
+    int rc = -1;
+
+    if (refresh_queue.nworkers == 0) return -1;
+
+    pthread_mutex_lock(&refresh_queue.lock);
+    if (pending_locked(uri, headers))
+        refresh_queue.deduped++;
+    else if (refresh_queue.head - refresh_queue.tail >= REFRESH_QUEUE)
+        refresh_queue.dropped++;
+    else {
+        RefreshJob *job = &refresh_queue.jobs[refresh_queue.head % REFRESH_QUEUE];
+        char *u = strdup(uri), *h = strdup(headers);
+        if (u == NULL || h == NULL) {
+            //메모리가 없으면 큐가 꽉 찼을 때처럼 버린다 (NULL이 큐에 들어가면 same_job이 죽음)
+            free(u);
+            free(h);
+            refresh_queue.dropped++;
+            pthread_mutex_unlock(&refresh_queue.lock);
+            return -1;
+        }
+        job->uri = u;
+        job->headers = h;
+        refresh_queue.head++;
+        refresh_queue.queued++;
+        pthread_cond_signal(&refresh_queue.cond);
+        rc = 0;
+    }
+    pthread_mutex_unlock(&refresh_queue.lock);
+    return rc;
+}
@@ -0,0 +1,35 @@
+#ifndef __REFRESH_H__
+#define __REFRESH_H__
+
+#include <pthread.h>
+
+/* 백그라운드 갱신 큐 크기와 기본 워커 수 */
+#define REFRESH_QUEUE 256
+#define REFRESH_WORKERS 2
+#define REFRESH_MAX_WORKERS 64
+
+/*
+ * 곧 만료될 인기 오브젝트를 요청 스레드 대신 다시 받아오는 워커 풀.
+ * 큐는 고정 크기이고, 같은 uri(와 변형)가 큐에 있거나 이미 갱신 중이면 다시 넣지 않는다.
+ */
+/* 갱신할 uri와, Vary 변형을 고르는 데 쓴 요청 헤더 (둘 다 strdup한 것) */
+typedef struct _RefreshJob{
+    char *uri;
+    char *headers;
+} RefreshJob;
+
+typedef struct _RefreshQueue{
+    RefreshJob jobs[REFRESH_QUEUE]; //대기 중인 작업
+    unsigned head, tail;
+    RefreshJob inflight[REFRESH_MAX_WORKERS]; //워커별로 지금 갱신 중인 작업
+    int nworkers;
+    unsigned long queued, deduped, dropped, done;
+    void (*refresh_fn)(char *uri, char *headers);
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} RefreshQueue;
+
+void init_refresh(int nworkers, void (*refresh_fn)(char *uri, char *headers));
+int schedule_refresh(char *uri, char *headers);
+
+#endif /* __REFRESH_H__ */
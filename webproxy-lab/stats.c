@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "csapp.h"
+#include "stats.h"
+#include "coro.h"
+
+ProxyStats proxy_stats;
+
+//이 스레드가 지금까지 쓴 CPU 시간 (ns). 벽시계가 아니라서 대기 시간은 안 들어감
+uint64_t thread_cpu_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * 카운터를 사람이 읽을 수 있게 buf에 쓰고 길이를 돌려준다 (dump_stats와 관리 채널이 씀).
+ * 시그널 핸들러에서 부르면 안 됨: SIGUSR1도 proxy.c의 signal_thread가 받아서 부른다
+ */
+int format_stats(char *buf, size_t len){
+    ProxyStats s;
+    int n;
+    double in_mb, ratio = 0, cpu_ms_per_mb = 0;
+    unsigned long rio_calls, syscalls;
+
+    s = proxy_stats; // 카운터끼리 정확히 맞을 필요는 없음
+    rio_calls = rio_syscall_count(); // 스레드별 카운터의 합
+    syscalls = rio_calls + s.io_uring_enters;
+    in_mb = s.gzip_in_bytes / (1024.0 * 1024.0);
+    if (s.gzip_in_bytes) {
+        ratio = (double)s.gzip_out_bytes / s.gzip_in_bytes;
+        cpu_ms_per_mb = s.gzip_cpu_ns / 1e6 / in_mb;
+    }
+    n = snprintf(buf, len,
+                 "requests %lu  cache hits %lu (%.1f%%)\n"
+                 "gzip: responses %lu  in %.2f MB  out %.2f MB  ratio %.3f  cpu %.2f ms/MB\n"
+                 "io: rio read/write %lu  io_uring_enter %lu  syscalls/request %.2f  flow pauses %lu\n",
+                 s.requests, s.cache_hits,
+                 s.requests ? 100.0 * s.cache_hits / s.requests : 0.0,
+                 s.gzip_responses, in_mb, s.gzip_out_bytes / (1024.0 * 1024.0),
+                 ratio, cpu_ms_per_mb,
+                 rio_calls, s.io_uring_enters,
+                 s.requests ? (double)syscalls / s.requests : 0.0, s.relay_pauses);
+    if (n < 0 || (size_t)n >= len)
+        return n < 0 ? 0 : (int)len - 1;
+    n += sched_stats(buf + n, len - n); // -c가 아니면 빈 문자열
+    return n;
+}
+
+void dump_stats(int fd){
+    char buf[STATS_BUF];
+
+    write(fd, buf, format_stats(buf, sizeof(buf)));
+}
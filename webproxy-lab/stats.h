@@ -0,0 +1,31 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdint.h>
+
+/*
+ * 프록시 전체에서 모으는 카운터. 여러 스레드가 동시에 올리므로
+ * STAT_ADD로 atomic하게만 더한다. SIGUSR1을 받거나 종료할 때 출력.
+ */
+typedef struct _ProxyStats{
+    unsigned long requests;       // 처리한 요청 수
+    unsigned long cache_hits;     // 캐시에서 내보낸 요청 수
+    unsigned long gzip_responses; // 프록시가 gzip으로 압축해서 보낸 응답 수
+    uint64_t gzip_in_bytes;       // 압축 전 본문 바이트
+    uint64_t gzip_out_bytes;      // 압축 후 본문 바이트
+    uint64_t gzip_cpu_ns;         // deflate에 쓴 CPU 시간 (스레드 CPU 시간 기준)
+    unsigned long io_uring_enters; // 중계에 쓴 io_uring_enter 호출 수 (-e uring)
+    unsigned long relay_pauses;   // 클라이언트가 느려 창(IO_RELAY_HIGH)이 차서 원 서버 읽기를 멈춘 횟수
+} ProxyStats;
+
+extern ProxyStats proxy_stats;
+
+#define STAT_ADD(field, n) __atomic_add_fetch(&proxy_stats.field, (n), __ATOMIC_RELAXED)
+
+#define STATS_BUF 8192 // format_stats 출력용. 스케줄러(최대 CORO_MAX_SCHEDS)마다 한 줄씩 붙음
+
+uint64_t thread_cpu_ns();
+int format_stats(char *buf, size_t len);
+void dump_stats(int fd);
+
+#endif /* __STATS_H__ */
@@ -1,27 +1,33 @@
 /*
  * adder.c - a minimal CGI program that adds two numbers together
+ *
+ *   그냥 실행하면 보통 CGI처럼 QUERY_STRING을 읽어 한 번 응답하고 끝난다.
+ *   "--tiny-worker"로 실행되면 tiny의 상주 워커로서 stdin으로 들어오는
+ *   요청 프레임마다 응답 프레임을 돌려준다 (cgiproto.h).
  */
 /* $begin adder */
 #include "csapp.h"
+#include "cgiproto.h"
 
-int main(void)
+/* query에 대한 CGI 출력(헤더 + 빈 줄 + 본문)을 out에 만든다 */
+static int make_response(char *query, char *out)
 {
-  char *buf, *p;
+  char *buf = query, *p = NULL;
   char arg1[MAXLINE], arg2[MAXLINE], content[MAXLINE];
   int n1 = 0, n2 = 0;
 
   /* Extract the two arguments */
-  if ((buf = getenv("QUERY_STRING")) != NULL)
+  if (buf != NULL && (p = strchr(buf, '&')) != NULL)
   {
-    p = strchr(buf, '&');
     *p = '\0';
     strcpy(arg1, buf);
     strcpy(arg2, p + 1);
-    n1 = atoi(strchr(arg1, '=') + 1);
-    n2 = atoi(strchr(arg2, '=') + 1);
+    if ((p = strchr(arg1, '=')) != NULL)
+      n1 = atoi(p + 1);
+    if ((p = strchr(arg2, '=')) != NULL)
+      n2 = atoi(p + 1);
   }
 
-  
   /* Make the response body */
   sprintf(content, "QUERY_STRING=%s\r\n<p>", buf);
   sprintf(content + strlen(content), "Welcome to add.com: ");
@@ -31,10 +37,32 @@ int main(void)
   sprintf(content + strlen(content), "Thanks for visiting!\r\n");
 
   /* Generate the HTTP response */
-  printf("Content-type: text/html\r\n");
-  printf("Content-length: %d\r\n", (int)strlen(content));
-  printf("\r\n");
-  printf("%s", content);
+  // 결과는 QUERY_STRING만으로 정해지므로 tiny(와 프록시)가 캐시해도 된다
+  return sprintf(out, "Content-type: text/html\r\n"
+                      "Cache-Control: max-age=60\r\n"
+                      "Content-length: %d\r\n\r\n%s",
+                 (int)strlen(content), content);
+}
+
+int main(int argc, char **argv)
+{
+  char query[MAXLINE], out[2 * MAXLINE];
+  ssize_t n;
+
+  if (argc > 1 && !strcmp(argv[1], CGI_WORKER_ARG))
+  {
+    // 상주 워커: tiny가 소켓을 닫을 때까지 요청마다 응답
+    while ((n = cgi_read_frame(STDIN_FILENO, query, sizeof(query) - 1)) >= 0)
+    {
+      query[n] = '\0';
+      if (cgi_write_frame(STDOUT_FILENO, out, make_response(query, out)) < 0)
+        break;
+    }
+    exit(0);
+  }
+
+  make_response(getenv("QUERY_STRING"), out);
+  printf("%s", out);
   fflush(stdout);
 
   exit(0);
@@ -0,0 +1,144 @@
+/*
+ * cgicache.c - CGI 응답 캐시.
+ *
+ *   같은 QUERY_STRING이면 늘 같은 결과를 내는 스크립트(예: adder)는
+ *   Cache-Control: max-age=N으로 캐시를 허락할 수 있다. 그러면 N초 동안은
+ *   스크립트를 다시 실행하지 않고 메모리에 둔 출력으로 답한다.
+ *   전체 크기는 cgi_cache_cap으로 묶고, 넘치면 LRU로 내보낸다.
+ *   tiny는 한 번에 요청 하나만 처리하므로 락은 없다.
+ */
+#include "csapp.h"
+#include "cgicache.h"
+
+size_t cgi_cache_cap = CGI_CACHE_DEFAULT;
+
+static cgi_entry *buckets[CGI_CACHE_BUCKETS];
+static cgi_entry *head, *tail;
+static size_t total;
+
+static unsigned long hash_key(char *s)
+{
+  unsigned long h = 5381;
+
+  while (*s)
+    h = h * 33 + (unsigned char)*s++;
+  return h;
+}
+
+static void lru_unlink(cgi_entry *e)
+{
+  if (e->prev) e->prev->next = e->next; else head = e->next;
+  if (e->next) e->next->prev = e->prev; else tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void lru_push(cgi_entry *e)
+{
+  e->next = head;
+  if (head) head->prev = e;
+  head = e;
+  if (tail == NULL) tail = e;
+}
+
+static void remove_entry(cgi_entry *e)
+{
+  cgi_entry **pp = &buckets[e->hash & (CGI_CACHE_BUCKETS - 1)];
+
+  while (*pp != e)
+    pp = &(*pp)->hnext;
+  *pp = e->hnext;
+  lru_unlink(e);
+  total -= e->size;
+  free(e->key);
+  free(e->data);
+  free(e);
+}
+
+static cgi_entry *lookup(char *key, unsigned long hash)
+{
+  for (cgi_entry *e = buckets[hash & (CGI_CACHE_BUCKETS - 1)]; e; e = e->hnext)
+    if (e->hash == hash && !strcmp(e->key, key))
+      return e;
+  return NULL;
+}
+
+static void make_key(char *path, char *query, char *key)
+{
+  snprintf(key, 2 * MAXLINE, "%s?%s", path, query);
+}
+
+/* 신선한 엔트리가 있으면 out에 복사하고 길이를, 없으면 -1을 돌려준다 */
+int cgi_cache_get(char *path, char *query, char *out, size_t cap)
+{
+  char key[2 * MAXLINE];
+  cgi_entry *e;
+
+  if (cgi_cache_cap == 0)
+    return -1;
+  make_key(path, query, key);
+  if ((e = lookup(key, hash_key(key))) == NULL)
+    return -1;
+  if (e->expires <= time(NULL) || e->size > cap)
+  {
+    remove_entry(e);
+    return -1;
+  }
+  lru_unlink(e);
+  lru_push(e);
+  memcpy(out, e->data, e->size);
+  return e->size;
+}
+
+/* CGI 출력 n바이트를 ttl초 동안 저장한다 (같은 키가 있으면 바꿔 넣음) */
+void cgi_cache_put(char *path, char *query, char *out, size_t n, long ttl)
+{
+  char key[2 * MAXLINE];
+  cgi_entry *e;
+
+  if (cgi_cache_cap == 0 || ttl <= 0 || n > cgi_cache_cap / 4)
+    return; // 큰 응답 하나가 캐시를 다 비우지 않도록
+  make_key(path, query, key);
+  if ((e = lookup(key, hash_key(key))) != NULL)
+    remove_entry(e);
+  while (total + n > cgi_cache_cap && tail)
+    remove_entry(tail);
+
+  if ((e = calloc(1, sizeof(*e))) == NULL)
+    return;
+  if ((e->key = strdup(key)) == NULL || (e->data = malloc(n)) == NULL)
+  {
+    free(e->key);
+    free(e);
+    return;
+  }
+  memcpy(e->data, out, n);
+  e->size = n;
+  e->hash = hash_key(key);
+  e->expires = time(NULL) + ttl;
+  e->hnext = buckets[e->hash & (CGI_CACHE_BUCKETS - 1)];
+  buckets[e->hash & (CGI_CACHE_BUCKETS - 1)] = e;
+  lru_push(e);
+  total += n;
+}
+
+/*
+ * CGI 헤더 한 줄이 Cache-Control이면 허락된 캐시 시간(초)을 돌려준다.
+ * max-age가 없거나 no-store/no-cache가 있으면 0, Cache-Control이 아니면 -1.
+ */
+long cgi_cache_ttl(char *line)
+{
+  char lower[MAXLINE];
+  char *p;
+  int i;
+
+  if (strncasecmp(line, "Cache-Control:", 14))
+    return -1;
+  for (i = 0; line[i] && line[i] != '\n' && i < MAXLINE - 1; i++)
+    lower[i] = tolower((unsigned char)line[i]);
+  lower[i] = '\0';
+  if (strstr(lower, "no-store") || strstr(lower, "no-cache"))
+    return 0;
+  if ((p = strstr(lower, "max-age=")) == NULL)
+    return 0;
+  return atol(p + 8);
+}
@@ -0,0 +1,31 @@
+#ifndef __CGICACHE_H__
+#define __CGICACHE_H__
+
+#include <stddef.h>
+#include <time.h>
+
+/* CGI 응답 캐시 기본 용량과 해시 버킷 수 (2의 거듭제곱) */
+#define CGI_CACHE_DEFAULT (1 << 20)
+#define CGI_CACHE_BUCKETS 256
+
+/*
+ * 스크립트 경로 + QUERY_STRING -> CGI 출력(헤더 + 본문).
+ * 응답에 Cache-Control: max-age=N을 붙인 스크립트만 N초 동안 저장된다.
+ */
+typedef struct _cgi_entry {
+  char *key;       // "경로?QUERY_STRING"
+  unsigned long hash;
+  char *data;      // CGI 출력 그대로
+  size_t size;
+  time_t expires;
+  struct _cgi_entry *prev, *next; // LRU (head가 가장 최근)
+  struct _cgi_entry *hnext;       // 같은 버킷의 다음 엔트리
+} cgi_entry;
+
+extern size_t cgi_cache_cap; // 0이면 캐시하지 않음
+
+int cgi_cache_get(char *path, char *query, char *out, size_t cap);
+void cgi_cache_put(char *path, char *query, char *out, size_t n, long ttl);
+long cgi_cache_ttl(char *line);
+
+#endif /* __CGICACHE_H__ */
@@ -0,0 +1,302 @@
+/*
+ * cgipool.c - CGI 프로세스 관리.
+ *
+ *   상주 워커 풀: 스크립트를 처음 요청받을 때 워커를 cgi_pool_size개
+ *   띄워두고, 그 뒤의 요청은 프로세스를 새로 만들지 않고 cgiproto.h
+ *   프레임으로 워커에게 넘긴다. 워커가 죽었거나 응답이 이상하면 그
+ *   워커만 다시 띄운다.
+ *
+ *   요청마다 실행: 풀을 쓰지 않으면 posix_spawn으로 스크립트를 띄우고
+ *   출력을 파이프로 받는다. fork처럼 tiny의 페이지 테이블을 복사하지 않는다.
+ *
+ *   자식 회수: SIGCHLD는 막아두고 signalfd로만 받는다. cgi_reap이
+ *   끝난 자식을 WNOHANG으로 모두 거두고, 죽은 워커는 풀에서 지운다.
+ */
+#include "csapp.h"
+#include <poll.h>
+#include <spawn.h>
+#include <sys/signalfd.h>
+#include "cgiproto.h"
+#include "cgipool.h"
+
+int cgi_pool_size = 0;
+
+static cgi_pool pools[CGI_POOL_SCRIPTS];
+static int reap_fd = -1; // SIGCHLD를 받는 signalfd
+
+static long now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+// SIGCHLD를 막고 signalfd로 돌린다. 자식을 띄우기 전에 한 번 부른다.
+void cgi_init(void)
+{
+  sigset_t mask;
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+  if ((reap_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+    unix_error("signalfd error");
+}
+
+/*
+ * path를 posix_spawn으로 띄운다. stdin_fd/stdout_fd가 자식의 stdin/stdout이 되고
+ * (-1이면 물려주지 않음), query가 있으면 QUERY_STRING으로 넘긴다.
+ * 막아둔 SIGCHLD가 자식에게 그대로 넘어가지 않도록 시그널 마스크는 비운다.
+ */
+static pid_t spawn_cgi(char *path, char **argv, char *query, int stdin_fd, int stdout_fd)
+{
+  posix_spawn_file_actions_t fa;
+  posix_spawnattr_t attr;
+  sigset_t none;
+  char qs[MAXLINE + 16], **envp = environ;
+  pid_t pid;
+  int n = 0, rc;
+
+  if (query != NULL)
+  {
+    // QUERY_STRING만 바꾼 환경 (tiny 자신의 환경은 건드리지 않는다)
+    while (environ[n])
+      n++;
+    if ((envp = malloc((n + 2) * sizeof(char *))) == NULL)
+      return -1;
+    snprintf(qs, sizeof(qs), "QUERY_STRING=%s", query);
+    envp[0] = qs;
+    n = 1;
+    for (char **e = environ; *e; e++)
+      if (strncmp(*e, "QUERY_STRING=", 13))
+        envp[n++] = *e;
+    envp[n] = NULL;
+  }
+
+  posix_spawn_file_actions_init(&fa);
+  if (stdin_fd >= 0)
+    posix_spawn_file_actions_adddup2(&fa, stdin_fd, STDIN_FILENO);
+  if (stdout_fd >= 0)
+    posix_spawn_file_actions_adddup2(&fa, stdout_fd, STDOUT_FILENO);
+  posix_spawnattr_init(&attr);
+  sigemptyset(&none);
+  posix_spawnattr_setsigmask(&attr, &none);
+  // 자식마다 자기 프로세스 그룹: 시간이 넘으면 CGI가 띄운 손자까지 같이 죽인다
+  posix_spawnattr_setpgroup(&attr, 0);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+
+  rc = posix_spawn(&pid, path, &fa, &attr, argv, envp);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&fa);
+  if (envp != environ)
+    free(envp);
+  return rc == 0 ? pid : -1;
+}
+
+static int spawn_worker(cgi_pool *p, cgi_worker *w)
+{
+  char *argv[] = { p->path, CGI_WORKER_ARG, NULL };
+  struct timeval tv = { CGI_TIMEOUT, 0 };
+  int sv[2];
+  pid_t pid;
+
+  // CLOEXEC라서 자식에게는 dup2한 stdin/stdout만 남는다
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+    return -1;
+  pid = spawn_cgi(p->path, argv, NULL, sv[1], sv[1]);
+  close(sv[1]);
+  if (pid < 0)
+  {
+    close(sv[0]);
+    return -1;
+  }
+  // 워커가 멈추면 tiny 전체가 멈추므로 응답 대기에 시간 제한
+  setsockopt(sv[0], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  w->pid = pid;
+  w->fd = sv[0];
+  w->served = 0;
+  return 0;
+}
+
+static void kill_worker(cgi_worker *w)
+{
+  if (w->pid == 0)
+    return;
+  close(w->fd);
+  kill(-w->pid, SIGKILL);
+  waitpid(w->pid, NULL, 0);
+  w->pid = 0;
+}
+
+static cgi_pool *find_pool(char *path)
+{
+  cgi_pool *empty = NULL;
+
+  for (int i = 0; i < CGI_POOL_SCRIPTS; i++)
+  {
+    if (!strcmp(pools[i].path, path))
+      return &pools[i];
+    if (!empty && pools[i].path[0] == '\0')
+      empty = &pools[i];
+  }
+  if (empty == NULL || strlen(path) >= sizeof(empty->path))
+    return NULL;
+  // 처음 보는 스크립트: 워커들을 미리 띄워둔다 (prefork)
+  strcpy(empty->path, path);
+  for (int i = 0; i < cgi_pool_size && i < CGI_POOL_MAX; i++)
+    spawn_worker(empty, &empty->workers[i]);
+  return empty;
+}
+
+/*
+ * path 스크립트의 워커에게 query를 넘기고 CGI 출력(헤더 + 본문)을 out에 받는다.
+ * 출력 길이를 돌려주고, 워커가 CGI_TIMEOUT 안에 답하지 않으면 CGI_ERR_TIMEOUT,
+ * 풀을 쓸 수 없으면 CGI_ERR_FAIL (호출한 쪽이 cgi_spawn_run으로 처리).
+ */
+int cgi_pool_run(char *path, char *query, char *out, size_t cap)
+{
+  int nworkers = cgi_pool_size < CGI_POOL_MAX ? cgi_pool_size : CGI_POOL_MAX;
+  cgi_pool *p;
+
+  if (nworkers <= 0 || (p = find_pool(path)) == NULL || p->disabled)
+    return CGI_ERR_FAIL;
+
+  // 고장 난 워커를 한 번은 새로 띄워서 다시 시도한다
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    cgi_worker *w = &p->workers[p->next];
+    ssize_t n;
+
+    p->next = (p->next + 1) % nworkers;
+    if (w->pid == 0 && spawn_worker(p, w) < 0)
+      return CGI_ERR_FAIL;
+    if (cgi_write_frame(w->fd, query, strlen(query)) == 0
+        && (n = cgi_read_frame(w->fd, out, cap)) >= 0)
+    {
+      w->served++;
+      return n;
+    }
+    // 멈춘 워커는 다시 시도하지 않는다 (또 CGI_TIMEOUT만큼 기다리게 되므로).
+    // SO_RCVTIMEO가 지난 것만 타임아웃: EOF(EPIPE)나 너무 큰 프레임(EMSGSIZE)은 아님
+    int timed_out = errno == EAGAIN || errno == EWOULDBLOCK;
+    int fresh = w->served == 0;
+    kill_worker(w);
+    if (timed_out)
+      return CGI_ERR_TIMEOUT;
+    if (fresh)
+    {
+      // 첫 요청부터 프레임으로 답하지 못하면 워커 모드를 모르는 보통 CGI
+      p->disabled = 1;
+      for (int i = 0; i < CGI_POOL_MAX; i++)
+        kill_worker(&p->workers[i]);
+      return CGI_ERR_FAIL;
+    }
+  }
+  return CGI_ERR_FAIL;
+}
+
+/*
+ * 끝난 자식을 모두 거둔다 (기다리지 않음). 풀의 워커였으면 빈 칸으로 만든다.
+ * want가 그중에 있었으면 1을 돌려준다.
+ */
+int cgi_reap(pid_t want)
+{
+  struct signalfd_siginfo si;
+  int found = 0;
+  pid_t pid;
+
+  while (read(reap_fd, &si, sizeof(si)) == sizeof(si))
+    ; // 쌓인 알림은 비우기만 하고, 실제 회수는 waitpid로
+  while ((pid = waitpid(-1, NULL, WNOHANG)) > 0)
+  {
+    if (pid == want)
+      found = 1;
+    for (int i = 0; i < CGI_POOL_SCRIPTS; i++)
+      for (int j = 0; j < CGI_POOL_MAX; j++)
+        if (pools[i].workers[j].pid == pid)
+        {
+          close(pools[i].workers[j].fd);
+          pools[i].workers[j].pid = 0;
+        }
+  }
+  return found;
+}
+
+// pid가 끝나기를 deadline까지 signalfd로 기다리고, 넘기면 죽여서 거둔다
+static void wait_child(pid_t pid, long deadline)
+{
+  struct pollfd pfd = { reap_fd, POLLIN, 0 };
+
+  while (!cgi_reap(pid))
+  {
+    long left = deadline - now_ms();
+    if (left <= 0 || poll(&pfd, 1, left) == 0)
+    {
+      kill(-pid, SIGKILL);
+      waitpid(pid, NULL, 0);
+      return;
+    }
+  }
+}
+
+/*
+ * path를 요청마다 새로 띄워 실행하고 CGI 출력(헤더 + 본문)을 out에 받는다.
+ * 출력 길이, 또는 CGI_ERR_FAIL / CGI_ERR_TIMEOUT을 돌려준다.
+ */
+int cgi_spawn_run(char *path, char *query, char *out, size_t cap)
+{
+  char *argv[] = { path, NULL };
+  struct pollfd pfd;
+  long deadline = now_ms() + CGI_TIMEOUT * 1000L;
+  size_t n = 0;
+  int p[2], rc = CGI_ERR_FAIL;
+  pid_t pid;
+
+  if (pipe(p) < 0)
+    return CGI_ERR_FAIL;
+  // 자식에게는 dup2한 stdout만 남도록
+  fcntl(p[0], F_SETFD, FD_CLOEXEC);
+  fcntl(p[1], F_SETFD, FD_CLOEXEC);
+  pid = spawn_cgi(path, argv, query, -1, p[1]);
+  close(p[1]);
+  if (pid < 0)
+  {
+    close(p[0]);
+    return CGI_ERR_FAIL;
+  }
+
+  pfd.fd = p[0];
+  pfd.events = POLLIN;
+  while (1)
+  {
+    long left = deadline - now_ms();
+    ssize_t r;
+    int ready = 0;
+
+    if (left <= 0 || (ready = poll(&pfd, 1, left)) == 0)
+    {
+      rc = CGI_ERR_TIMEOUT;
+      break;
+    }
+    if (ready < 0)
+      continue;
+    if (n == cap)
+      break; // 출력이 버퍼보다 큼
+    if ((r = read(p[0], out + n, cap - n)) < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+    {
+      if (r == 0)
+        rc = n;
+      break;
+    }
+    n += r;
+  }
+  close(p[0]);
+  if (rc < 0)
+    kill(-pid, SIGKILL);
+  wait_child(pid, deadline);
+  return rc;
+}
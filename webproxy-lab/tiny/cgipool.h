@@ -0,0 +1,35 @@
+#ifndef __CGIPOOL_H__
+#define __CGIPOOL_H__
+
+#include <sys/types.h>
+
+/* 스크립트마다 미리 띄워두는 상주 CGI 워커 수의 상한과 관리할 수 있는 스크립트 수 */
+#define CGI_POOL_MAX 16
+#define CGI_POOL_SCRIPTS 8
+#define CGI_TIMEOUT 5 // CGI(워커든 요청마다 띄운 프로세스든) 응답을 기다리는 최대 시간 (초)
+
+/* cgi_spawn_run이 돌려주는 실패 값 */
+#define CGI_ERR_FAIL    -1 // 실행 못 함, 출력이 너무 큼
+#define CGI_ERR_TIMEOUT -2 // CGI_TIMEOUT 안에 끝나지 않아서 죽임
+
+typedef struct {
+  pid_t pid; // 0이면 빈 칸 (죽었거나 아직 안 띄움)
+  int fd;    // 워커와 연결된 유닉스 소켓 (tiny 쪽)
+  unsigned long served; // 이 워커가 답한 요청 수
+} cgi_worker;
+
+typedef struct {
+  char path[256];          // 스크립트 경로 (예: ./cgi-bin/adder)
+  cgi_worker workers[CGI_POOL_MAX];
+  int next;                // 다음에 쓸 워커 (round robin)
+  int disabled;            // 워커 모드를 모르는 스크립트 (요청마다 띄움)
+} cgi_pool;
+
+extern int cgi_pool_size; // 0이면 풀을 쓰지 않음 (요청마다 posix_spawn)
+
+void cgi_init(void);
+int cgi_pool_run(char *path, char *query, char *out, size_t cap);
+int cgi_spawn_run(char *path, char *query, char *out, size_t cap);
+int cgi_reap(pid_t want);
+
+#endif /* __CGIPOOL_H__ */
@@ -0,0 +1,78 @@
+/*
+ * cgiproto.h - tiny와 상주(persistent) CGI 워커 사이의 프레임 규약.
+ *
+ *   tiny는 워커를 "<script> --tiny-worker"로 한 번 띄우고, 유닉스 소켓을
+ *   워커의 stdin/stdout으로 넘겨준다. 요청마다
+ *     tiny -> 워커 : [4바이트 길이 (network order)][QUERY_STRING]
+ *     워커 -> tiny : [4바이트 길이 (network order)][CGI 출력 (헤더 + 빈 줄 + 본문)]
+ *   을 주고받는다. 워커는 stdin이 닫히면 끝난다.
+ *
+ *   CGI 프로그램과 tiny가 같이 include하므로 헤더 안에 static inline 함수로 둔다.
+ */
+#ifndef __CGIPROTO_H__
+#define __CGIPROTO_H__
+
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#define CGI_WORKER_ARG "--tiny-worker"
+#define CGI_MAX_FRAME (1 << 20)
+
+// n바이트를 다 주고받으면 0. 실패하면 -1이고 errno를 남긴다: 상대가 닫았으면 EPIPE,
+// 그 밖에는 read/send의 errno (SO_RCVTIMEO가 지나면 EAGAIN)
+static inline int cgi_io(int fd, char *buf, size_t n, int writing)
+{
+  size_t done = 0;
+
+  while (done < n)
+  {
+    // 워커가 죽었을 때 SIGPIPE로 tiny까지 죽지 않도록 MSG_NOSIGNAL
+    ssize_t r = writing ? send(fd, buf + done, n - done, MSG_NOSIGNAL)
+                        : read(fd, buf + done, n - done);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r == 0)
+    {
+      errno = EPIPE;
+      return -1;
+    }
+    if (r < 0)
+      return -1;
+    done += r;
+  }
+  return 0;
+}
+
+// 프레임 하나를 보낸다. 성공하면 0
+static inline int cgi_write_frame(int fd, const char *buf, uint32_t len)
+{
+  uint32_t nlen = htonl(len);
+
+  if (cgi_io(fd, (char *)&nlen, 4, 1) < 0)
+    return -1;
+  return cgi_io(fd, (char *)buf, len, 1);
+}
+
+// 프레임 하나를 buf(크기 cap)에 받는다. 내용 길이를 돌려주고, 끊기면 -1,
+// 너무 크면(프레임이 아닌 보통 CGI 출력이기 쉬움) errno = EMSGSIZE로 -1
+static inline ssize_t cgi_read_frame(int fd, char *buf, uint32_t cap)
+{
+  uint32_t len;
+
+  if (cgi_io(fd, (char *)&len, 4, 0) < 0)
+    return -1;
+  len = ntohl(len);
+  if (len > cap)
+  {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  if (cgi_io(fd, buf, len, 0) < 0)
+    return -1;
+  return len;
+}
+
+#endif /* __CGIPROTO_H__ */